@@ -0,0 +1,65 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief Bump allocator. Memory is carved out of large blocks in the order
+ * it is requested and is only released all at once by arena_free(), so
+ * objects allocated together sit next to each other in memory.
+ *
+ */
+typedef struct arena_block
+{
+  struct arena_block* next; // Previously filled block.
+  size_t size;              // Bytes available in data.
+  size_t used;              // Bytes handed out from data.
+  char data[];
+} ARENA_BLOCK;
+
+typedef struct
+{
+  ARENA_BLOCK* blocks; // Block currently being filled, then older ones.
+} ARENA;
+
+/**
+ * @brief Allocates size bytes, suitably aligned for any type.
+ * The memory is not cleared. Exits if the system is out of memory.
+ *
+ * @param arena
+ * @param size
+ * @return void*
+ */
+void*
+arena_alloc(ARENA* arena, size_t size);
+
+/**
+ * @brief Allocates len bytes without alignment padding, for strings.
+ *
+ * @param arena
+ * @param len
+ * @return char*
+ */
+char*
+arena_alloc_chars(ARENA* arena, size_t len);
+
+/**
+ * @brief Copies len bytes of str into the arena as a NUL-terminated string.
+ *
+ * @param arena
+ * @param str
+ * @param len
+ * @return char*
+ */
+char*
+arena_strndup(ARENA* arena, const char* str, size_t len);
+
+/**
+ * @brief Releases every block of the arena at once.
+ *
+ * @param arena
+ */
+void
+arena_free(ARENA* arena);
+
+#endif
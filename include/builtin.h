@@ -0,0 +1,32 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include "cookbook.h"
+
+/**
+ * @brief Largest file the cp builtin copies; bigger ones are left to the
+ * real cp, so that a long copy doesn't hold up the scheduler.
+ *
+ */
+#define BUILTIN_MAX_COPY (4 << 20)
+
+/**
+ * @brief Runs a step inside cook itself, without starting a process, if it
+ * is one of the simple commands cook knows how to do: "rm -f files...",
+ * "mkdir -p directories...", "touch files...", "cp file target" and
+ * "echo words..." with its output redirected to a file. A step with any
+ * other options, or whose program comes from UTIL_DIRECTORY, is left to be
+ * run as usual.
+ *
+ * The commands behave like their standard versions, reporting errors on
+ * stderr the same way.
+ *
+ * @param step
+ * @param out Descriptor of the step's output redirection, -1 if it has none
+ * @return int The exit status of the command, or -1 if the step has to be
+ * run as a process.
+ */
+int
+run_builtin(STEP* step, int out);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "cookbook.h"
+
+#define CACHE_DIR ".cook-cache"
+
+/**
+ * @brief Turns on the content-addressed build cache stored in CACHE_DIR.
+ * The cache is off unless this is called.
+ *
+ */
+void
+cache_enable();
+
+/**
+ * @brief Returns 1 if the build cache is turned on.
+ *
+ * @return int
+ */
+int
+cache_enabled();
+
+/**
+ * @brief Completes the cache keys of recipes that are about to be cooked,
+ * once the recipes they depend on are done. Each key hashes the recipe's
+ * task hash, the current contents of its input redirections and the keys
+ * of the recipes it depends on. The recipes are spread over a pool of threads, so none of
+ * them may depend on another. Does nothing if the cache is off.
+ *
+ * Input files are hashed here rather than up front because a dependency
+ * may write them, with a redirection or as an argument of one of its steps.
+ *
+ * @param ids Indices of the recipes in graph
+ * @param count
+ */
+void
+cache_compute_keys(int* ids, int count);
+
+/**
+ * @brief Restores the output redirection files of a recipe from the cache.
+ * Only recipes that redirect the output of at least one task are cached.
+ *
+ * @param id Index of the recipe in graph
+ * @return int 1 if all outputs were restored, 0 on a cache miss.
+ */
+int
+cache_restore(int id);
+
+/**
+ * @brief Saves the output redirection files of a recipe that was just cooked
+ * into the cache. Errors are ignored; a failed store only costs a future
+ * cache miss.
+ *
+ * @param id Index of the recipe in graph
+ */
+void
+cache_store(int id);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "cookbook.h"
+
+/**
+ * @brief Directory searched for the program of a step before PATH.
+ *
+ */
+#define UTIL_DIRECTORY "./util/"
+
+/**
+ * @brief Finds the program that runs a step whose first word is name.
+ * That is UTIL_DIRECTORY/name if it is executable, otherwise name itself
+ * if it contains a slash, otherwise the first executable file called name
+ * in a directory on PATH (as execvp() would search it).
+ *
+ * The answer for each distinct name is worked out once and remembered, so
+ * launching a step never has to try several paths.
+ *
+ * @param name
+ * @return char* Path of the program, or NULL if there is no such program.
+ */
+char*
+resolve_command(char* name);
+
+/**
+ * @brief Resolves the first word of every step of the recipes in graph up
+ * front, spreading the distinct names over a pool of threads, so that
+ * resolve_command() only has to look them up while cooking.
+ *
+ * Every name that doesn't resolve to a program is reported on stderr,
+ * together with a recipe that needs it.
+ *
+ * @return int Number of names that couldn't be resolved.
+ */
+int
+resolve_commands();
+
+/**
+ * @brief Returns 1 if name resolves to a program that isn't in
+ * UTIL_DIRECTORY, such as a standard system command.
+ *
+ * @param name
+ * @return int
+ */
+int
+is_system_command(char* name);
+
+/**
+ * @brief Returns 1 if a step is a plain "cat" with no arguments (and not a
+ * program of that name in UTIL_DIRECTORY), which only copies its standard
+ * input to its standard output.
+ *
+ * @param step
+ * @return int
+ */
+int
+is_pass_through(STEP* step);
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef CONCURRENCY_H
+#define CONCURRENCY_H
+
+#define CONCURRENCY_INTERVAL_MS 500 // How often the system load is sampled.
+#define CPU_PRESSURE_HIGH 40.0 // Stall percentage above which cooks don't grow.
+
+/**
+ * @brief Makes the number of cooks follow the number of CPUs this process
+ * may run on (see sched_getaffinity()), as for `-c auto`.
+ *
+ */
+void
+concurrency_auto();
+
+/**
+ * @brief Holds back new recipes while the load average, not counting the
+ * recipes being cooked, leaves less than one CPU of room below load, as
+ * for `-l load`. At least one recipe is always allowed.
+ *
+ * @param load
+ */
+void
+concurrency_max_load(double load);
+
+/**
+ * @brief Only admits recipes while the memory they are expected to need
+ * (their @mem hints) adds up to at most budget bytes. 0 means no limit.
+ *
+ * @param budget
+ */
+void
+concurrency_memory_budget(long long budget);
+
+/**
+ * @brief Parses a size such as "512M": a number optionally followed by
+ * K, M, G or T (powers of 1024).
+ *
+ * @param text
+ * @return long long Size in bytes, or -1 if text isn't a size.
+ */
+long long
+parse_size(char* text);
+
+/**
+ * @brief Fixes the number of cooks chosen on the command line (MAX_COOKS,
+ * or the CPU count with concurrency_auto()) as the most that will be used.
+ * Call after the options are parsed.
+ *
+ */
+void
+concurrency_start();
+
+/**
+ * @brief Returns 1 if MAX_COOKS is adjusted at runtime.
+ *
+ * @return int
+ */
+int
+concurrency_adaptive();
+
+/**
+ * @brief Sets MAX_COOKS from the CPU count, load average and CPU pressure
+ * stall information in /proc. The system is sampled at most once every
+ * CONCURRENCY_INTERVAL_MS; in between this does nothing.
+ *
+ * Called from the dispatch loop of process_queue() before each decision
+ * to start a recipe.
+ *
+ */
+void
+adjust_concurrency();
+
+/**
+ * @brief Reads the hints of every recipe in graph into its state: the
+ * number of cooks it occupies (@slots=N, default 1) and the memory it needs
+ * (@mem=size, default 0). Exits with an error if a hint is malformed.
+ *
+ */
+void
+read_recipe_hints();
+
+/**
+ * @brief Returns 1 if a ready recipe may start now: its slots fit in what is
+ * left of MAX_COOKS, its memory in what is left of the budget, and the
+ * jobserver (if any) has a token for each slot beyond the implicit one.
+ * When nothing is cooking any recipe is admitted, so one too big for the
+ * limits still runs (alone).
+ *
+ * @param id Index of the recipe in graph
+ * @return int 1 if admitted, 0 if not, -1 if the jobserver ran out of tokens
+ * (so no other recipe needing one can start either).
+ */
+int
+concurrency_admit(int id);
+
+/**
+ * @brief Charges the slots and memory of a recipe that starts cooking
+ * against ACTIVE_COOKS and the memory budget.
+ *
+ * @param id
+ */
+void
+concurrency_started(int id);
+
+/**
+ * @brief Gives back the slots and memory of a recipe that is done cooking,
+ * and the jobserver tokens no longer needed.
+ *
+ * @param id
+ */
+void
+concurrency_finished(int id);
+
+/**
+ * @brief Notes that jobserver tokens may be available again: the pool
+ * became readable while cook was waiting for one.
+ *
+ */
+void
+concurrency_tokens_returned();
+
+/**
+ * @brief Returns 1 if, since the last call, room may have been made for
+ * recipes that concurrency_admit() turned away: a recipe was done cooking,
+ * MAX_COOKS went up or jobserver tokens came back.
+ *
+ * @return int
+ */
+int
+concurrency_room_changed();
+
+#endif
@@ -29,11 +29,26 @@ typedef struct recipe_link
   struct recipe_link* next; // Next link in the dependency list.
 } RECIPE_LINK;
 
+/*
+ * A "recipe attribute" is a hint about how to carry out a recipe, such as
+ * how much memory it needs.  Attributes are written in the recipe header
+ * among the sub-recipe names, as words of the form "@name=value" (for
+ * example "@mem=4G" or "@slots=2").  The attributes of a recipe are chained
+ * together into a list, in the order in which they appear.
+ */
+typedef struct recipe_attribute
+{
+  char* name;                    // Name of the attribute, without the '@'.
+  char* value;                   // Text after the '='.
+  struct recipe_attribute* next; // Next attribute of the recipe.
+} RECIPE_ATTRIBUTE;
+
 typedef struct recipe
 {
   char* name;                   // Name of the recipe.
   RECIPE_LINK* this_depends_on; // List of recipes on which this recipe depends.
   RECIPE_LINK* depend_on_this;  // List of recipes that depend on this recipe.
+  RECIPE_ATTRIBUTE* attributes; // Hints given in the recipe header.
   struct task* tasks;           // Tasks to perform to complete the recipe.
   struct recipe* next;          // Next recipe in the cookbook.
   void* state;                  // Any additional state info you need to add.
@@ -78,11 +93,47 @@ typedef struct step
  * If parsing was successful, then this variable is set to zero.
  *
  * The caller is responsible for freeing the object returned by this function
- * and for managing the input stream and closing it (if appropriate).
+ * (with free_cookbook()) and for managing the input stream and closing it
+ * (if appropriate).
  */
 COOKBOOK*
 parse_cookbook(FILE* in, int* errp);
 
+/*
+ * Function for freeing a cookbook returned by parse_cookbook().
+ * All of its recipes, links, tasks, steps and strings are allocated from
+ * arenas owned by the cookbook, so they are released together by this call
+ * and must not be freed individually.
+ */
+void
+free_cookbook(COOKBOOK* cbp);
+
+/*
+ * Function for allocating memory that lives as long as a cookbook, such as
+ * state attached to its recipes.  The memory is cleared to zero and is
+ * released by free_cookbook().  Successive allocations of the same size are
+ * laid out next to each other.
+ */
+void*
+cookbook_alloc(COOKBOOK* cbp, size_t size);
+
+/*
+ * Function for looking up a recipe in a parsed cookbook by name.
+ * This uses a hash index of the recipe names that parse_cookbook() builds
+ * and keeps in the cookbook's state, so it takes constant expected time.
+ * Returns NULL if the cookbook has no recipe with that name.
+ */
+RECIPE*
+find_recipe(COOKBOOK* cbp, char* name);
+
+/*
+ * Function for looking up an attribute of a recipe by name.
+ * Returns the value of the last attribute with that name, or NULL if the
+ * recipe has none.
+ */
+char*
+recipe_attribute(RECIPE* rp, char* name);
+
 /*
  * Function for outputting a cookbook to an output stream, in a format from
  * which it can be parsed again.
@@ -0,0 +1,60 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Streaming 64-bit hash (XXH64). Input can be fed in pieces of any
+ * size with hash_update(); the result only depends on the concatenation.
+ *
+ */
+typedef struct
+{
+  uint64_t total_len;
+  uint64_t v[4];
+  unsigned char mem[32];
+  size_t memsize;
+  uint64_t seed;
+} HASH_STATE;
+
+/**
+ * @brief Starts a new hash with the given seed.
+ *
+ * @param state
+ * @param seed
+ */
+void
+hash_init(HASH_STATE* state, uint64_t seed);
+
+/**
+ * @brief Feeds len bytes of data into the hash.
+ *
+ * @param state
+ * @param data
+ * @param len
+ */
+void
+hash_update(HASH_STATE* state, const void* data, size_t len);
+
+/**
+ * @brief Feeds a NUL-terminated string into the hash, including its
+ * terminator so that adjacent strings can't run into each other.
+ *
+ * @param state
+ * @param str
+ */
+void
+hash_string(HASH_STATE* state, const char* str);
+
+/**
+ * @brief Returns the hash of everything fed in so far. The state can keep
+ * being updated afterwards.
+ *
+ * @param state
+ * @return uint64_t
+ */
+uint64_t
+hash_final(HASH_STATE* state);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Open addressing with linear probing, shared by the hash tables of
+ * cook. A table is an array of slots whose size is a power of two; which
+ * slots are empty is up to the code using it.
+ *
+ * Tables are sized with hashtable_capacity(), which keeps them at most half
+ * full, so probe sequences stay short and always end at an empty slot.
+ *
+ */
+
+/**
+ * @brief Smallest power of two, at least min (itself a power of two), that
+ * holds count entries at most half full.
+ *
+ * @param count
+ * @param min
+ * @return size_t
+ */
+size_t
+hashtable_capacity(size_t count, size_t min);
+
+/**
+ * @brief Walks the slots of a table from the one its hash points to until
+ * stop returns 1, which it must for an empty slot and for the slot holding
+ * key.
+ *
+ * @param slots
+ * @param slot_size Size of a slot in bytes
+ * @param capacity Number of slots, a power of two
+ * @param hash Hash of key
+ * @param stop
+ * @param key Passed on to stop
+ * @return size_t Index of the slot holding key, or of the empty slot where
+ * it would go.
+ */
+size_t
+hashtable_probe(const void* slots,
+                size_t slot_size,
+                size_t capacity,
+                uint64_t hash,
+                int (*stop)(const void* slot, const void* key),
+                const void* key);
+
+#endif
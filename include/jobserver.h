@@ -0,0 +1,68 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+/**
+ * @brief Joins or starts a GNU make compatible jobserver, so that nested
+ * make and cook invocations share one limit on how many jobs run at once.
+ *
+ * If MAKEFLAGS names a jobserver (--jobserver-auth=R,W, the older
+ * --jobserver-fds=R,W, or --jobserver-auth=fifo:PATH), cook becomes its
+ * client and, unless -c was given, lets the tokens alone limit how many
+ * recipes it cooks. Otherwise, if more than one cook is allowed, cook
+ * becomes the server: it makes a pipe holding MAX_COOKS - 1 tokens and
+ * exports it to the steps it runs through MAKEFLAGS.
+ *
+ * Like make, cook always owns one implicit token, so the first recipe it
+ * cooks needs no token from the pool and every further one needs one per
+ * slot. Tokens are read without blocking from a private, nonblocking open
+ * of the read end (through /proc/self/fd), so other users of the pipe are
+ * not affected.
+ *
+ * Call after concurrency_start(): a client that lifts MAX_COOKS also lifts
+ * the base that -l scales from.
+ *
+ * @param explicit_cooks 1 if the number of cooks was given with -c.
+ */
+void
+jobserver_setup(int explicit_cooks);
+
+/**
+ * @brief Tries to hold at least wanted tokens (besides the implicit one).
+ * Always succeeds when there is no jobserver.
+ *
+ * Once the pool ran dry, it isn't read again until tokens are given back
+ * with jobserver_release() or jobserver_refilled() is called.
+ *
+ * @param wanted
+ * @return int 1 if that many tokens are held now, 0 if the pool ran dry.
+ */
+int
+jobserver_acquire(int wanted);
+
+/**
+ * @brief Returns the tokens held beyond keep to the pool. Tokens taken by a
+ * jobserver_acquire() that then ran dry are kept until this is called.
+ *
+ * @param keep
+ */
+void
+jobserver_release(int keep);
+
+/**
+ * @brief Notes that jobserver_starved_fd() became readable, so that the
+ * next jobserver_acquire() reads the pool again.
+ *
+ */
+void
+jobserver_refilled();
+
+/**
+ * @brief Descriptor that becomes readable when tokens are returned to the
+ * pool, if the last jobserver_acquire() ran out of them; -1 otherwise.
+ *
+ * @return int
+ */
+int
+jobserver_starved_fd();
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#define MAX_PARALLEL_THREADS 16
+
+/**
+ * @brief Calls body(i, arg) for every i from 0 to count - 1, spread over up
+ * to one thread per online CPU (at most MAX_PARALLEL_THREADS, the calling
+ * thread included). Each thread claims the next index through an atomic
+ * counter, so the calls happen in no particular order. Returns once all of
+ * them are done; if no threads can be started, the calling thread does all
+ * the work.
+ *
+ * @param count
+ * @param body
+ * @param arg Passed on to every call of body.
+ */
+void
+parallel_for(int count, void (*body)(int i, void* arg), void* arg);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PIDMAP_H
+#define PIDMAP_H
+
+#include <sys/types.h>
+
+/**
+ * @brief Open-addressing hash table from the pid of a running child to the
+ * index of the recipe it is cooking, so that reaping a child takes constant time no
+ * matter how big the cookbook is.
+ *
+ * Only the scheduler thread touches the table: entries are added when steps
+ * are spawned, and looked up and removed in reap_completed_steps(), which
+ * runs from the dispatch loop once the SIGCHLD signalfd is readable.
+ *
+ */
+typedef struct
+{
+  pid_t pid; // 0 marks an empty slot.
+  int id;
+} PID_ENTRY;
+
+/**
+ * @brief Records that pid is cooking the recipe with index id.
+ *
+ * @param pid
+ * @param id
+ */
+void
+pidmap_insert(pid_t pid, int id);
+
+/**
+ * @brief Looks up the recipe a child is cooking.
+ *
+ * @param pid
+ * @return int Index of the recipe, or -1 if pid isn't in the table.
+ */
+int
+pidmap_find(pid_t pid);
+
+/**
+ * @brief Removes a reaped child from the table.
+ *
+ * @param pid
+ */
+void
+pidmap_remove(pid_t pid);
+
+#endif
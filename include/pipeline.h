@@ -1,13 +1,18 @@
 #ifndef PIPELINE_H
 #define PIPELINE_H
 
+#include "cache.h"
 #include "debug.h"
+#include "pidmap.h"
 #include "pipeline_utils.h"
 #include "recipe.h"
 #include "workqueue.h"
 
 #include <string.h>
 
+#define RETRY_DELAY_MS 100       // Wait before the first retry of a recipe.
+#define RETRY_MAX_DELAY_MS 30000 // Longest wait between two retries.
+
 #define READ_END 0
 #define WRITE_END 1
 
@@ -21,42 +26,110 @@
  * @brief "main processing loop" where all the queued up recipes
  * are handled.
  *
- * It takes the head of the queue and performs all the necessary tasks
- * for that recipe. After all the tasks for that recipe are completed, it will
- * dequeue that recipe.
+ * Recipes that are up to date, or restored from the cache, are finished as
+ * soon as they are ready, without taking a cook. Of the others, it takes the
+ * head of the queue and starts the first task of that recipe,
+ * launching the step processes itself; there is no process per recipe.
+ * Each time all the steps of a task have exited, the next task is started,
+ * and after the last one the recipe is finished.
  *
  * It moves on to the next head and continues until there are no more remaining
- * recipes left in the queue.
+ * recipes left in the queue. When no recipe can be started it sleeps in
+ * epoll until a SIGCHLD arrives on a signalfd, then reaps the finished
+ * steps in a batch.
+ *
+ * A recipe fails when one of its steps can't be started, exits with a
+ * non-zero status or is killed, or when it takes longer than its timeout;
+ * its remaining tasks are not started. While it has retries left it is queued again after a delay, and
+ * otherwise cook stops at once unless keep_going_enable() was
+ * called; then the recipes depending on it are skipped, everything else is
+ * still cooked, and the failed and skipped recipes are listed at the end.
  *
+ * @return int The number of recipes that failed.
  */
-void
+int
 process_queue();
 
 /**
- * @brief Establishes a pipe between the processes and executes
- * the tasks associates with a step in parallel.
+ * @brief Keeps cooking the recipes unaffected by a failure (the -k option).
+ */
+void
+keep_going_enable();
+
+/**
+ * @brief Sets how many times each recipe may be retried after failing: its
+ * @retries=N hint, or retries if it has none. Exits if a hint isn't valid.
  *
- * Parent writes the start step into the pipe and the children will
- * read from that pipe, perform the steps, and write the next step back
- * into the pipe.
+ * @param retries The number of retries given with --retries
+ */
+void
+read_retry_counts(int retries);
+
+/**
+ * @brief Parses a duration such as "90", "1.5s", "500ms", "10m" or "2h":
+ * a number of seconds unless it ends in ms, s, m or h.
  *
+ * @param text
+ * @return long long Duration in microseconds, or -1 if text isn't one.
  */
-int
-process_steps(TASK* task);
+long long
+parse_duration(char* text);
 
 /**
- * @brief First tries to run the command using execvp in the /util/ directory.
- * If it fails, it will try running it in the system directory.
- * If that fails as well, the program exits with 1.
+ * @brief Sets how long each recipe may take to cook: its @timeout=duration
+ * hint, or timeout_us if it has none (0 for no limit). Exits if a hint
+ * isn't valid.
+ *
+ * The steps of each task of a recipe with a timeout run in a process group
+ * of their own; once the time is up the whole group is killed and the recipe
+ * fails (or is retried), handing back its cooks at once.
  *
- * @param util_path Path of the /util/ directory
- * @param steps The actual command that needs to run
- * @return int
+ * @param timeout_us The timeout given with --timeout, in microseconds
  */
 void
-execute_command(char* util_path, char** steps);
+read_timeouts(long long timeout_us);
 
+/**
+ * @brief Sets the size of the pipes between the steps of each recipe: its
+ * @pipe_size=size hint, or pipe_size if it has none (0 for the system's
+ * default). Larger pipes let stages that stream a lot of data run with
+ * fewer context switches. Exits if a hint isn't valid.
+ *
+ * @param pipe_size The size given with --pipe-size, in bytes
+ */
+void
+read_pipe_sizes(int pipe_size);
+
+/**
+ * @brief Establishes a pipe between the processes and starts the steps of
+ * the current task of a recipe in parallel, without waiting for them.
+ *
+ * The pid of every step is recorded in the pid map, in the recipe's pids
+ * by position and counted in its running_steps, so the scheduler can tell
+ * which step exited and when the task is done. A task of a single step
+ * that run_builtin() can do is done before returning, without starting any
+ * process.
+ *
+ * @param id Index of the recipe in graph
+ * @return int 1 if the task has already failed, because its redirections or
+ * pipes can't be set up or one of its steps can't be started, 0 otherwise.
+ */
+int
+start_task(int id);
+
+/**
+ * @brief Reaps every step that has exited, without blocking. Once all the
+ * steps of a task are gone the recipe moves on to its next task; a recipe
+ * with no tasks left is finished and releases the recipes waiting on it.
+ * If any step of the task failed, the recipe is retried or given up on
+ * instead, blaming the rightmost step that failed like pipefail does.
+ *
+ * Called from the event loop of process_queue() whenever the SIGCHLD
+ * signalfd becomes readable, so the bookkeeping runs in normal context
+ * rather than in a signal handler.
+ *
+ */
 void
-completed_recipe_handler(int signo);
+reap_completed_steps();
 
 #endif
\ No newline at end of file
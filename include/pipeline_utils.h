@@ -5,32 +5,16 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "debug.h"
 
-/**
- * @brief Duplicates the fd to STDIN_FILENO.
- * Will exit with 1 if dup2 fails.
- *
- * @param fd
- */
-int
-redirect_input(int fd);
-
-/**
- * @brief Duplicates the fd to STDOUT_FILENO.
- * Will exit with 1 if dup2 fails.
- *
- * @param fd
- */
-int
-redirect_output(int fd);
-
 /**
  * @brief Opens a file with read only access.
+ * The descriptor is close-on-exec; returns 0 if path is NULL.
  *
  * If the file doesn't exists or opening fails,
  * the program exits with 1.
@@ -44,6 +28,7 @@ open_for_reading(char* path);
 /**
  * @brief Opens a file with read and write access.
  * If the file doesn't exist, one that will be created.
+ * The descriptor is close-on-exec; returns 0 if path is NULL.
  * Sets the chmod permissions to 0666 which sets permissions so that:
  * (U)ser / owner can read, can write and can't execute.
  * (G)roup can read, can write and can't execute.
@@ -61,13 +46,43 @@ open_for_writing(char* path);
 
 /**
  * @brief Initializes the 2D pipes using the pipe command.
+ * Both ends of every pipe are close-on-exec. Unless pipe_size is 0, each
+ * pipe's buffer is resized to (at least) pipe_size bytes if the system
+ * allows it.
  *
- * If any of the pipes fail to initialize, the program exits with 1.
+ * If any of the pipes fail to initialize, the ones already made are closed
+ * and 1 is returned.
  *
  * @param pipefd
  * @param number_of_steps
+ * @param pipe_size
+ */
+int
+initialize_pipes(int pipefd[][2], int number_of_steps, int pipe_size);
+
+/**
+ * @brief Writes all size bytes of data to fd, carrying on after short
+ * writes and interrupted calls.
+ *
+ * @param fd
+ * @param data
+ * @param size
+ * @return int 0, or -1 (with errno set) if a write fails.
+ */
+int
+write_all(int fd, const void* data, size_t size);
+
+/**
+ * @brief Copies everything from the current offset of in to the end of the
+ * file to out. Uses copy_file_range(), which lets the kernel (or the file
+ * system) do the copy, and falls back to read() and write() where that
+ * isn't supported.
+ *
+ * @param in
+ * @param out
+ * @return int 0, or -1 (with errno set) if reading or writing fails.
  */
 int
-initialize_pipes(int pipefd[][2], int number_of_steps);
+copy_contents(int in, int out);
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define RECIPE_H
 
 #include "cookbook.h"
+#include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
 
@@ -13,50 +14,123 @@ RECIPE* main_recipe;
  */
 typedef enum
 {
+  waiting, // Some dependencies have not finished yet.
   enqueue,
   started,
+  retrying, // Failed, and waiting for its retry timer to be queued again.
   finished,
-  failed
+  failed,
+  skipped // A dependency failed, so the recipe will never be cooked.
 } STATUS;
 
 /**
  * @brief The state of a recipe.
- * Currently just contains the status.
+ * Contains the status, the task being cooked and its build cache hashes.
  *
  */
 typedef struct
 {
   STATUS status;
-  pid_t worker_pid;
+  unsigned queued : 1; // Set once the recipe has been put on the work queue.
+  int pending; // Number of dependencies (counted per link) not finished yet.
+  long estimate; // Expected wall time in microseconds (see stats_estimate()).
+  long priority; // Sum of the estimates on the longest path to the main recipe.
+  struct task* task; // Task being cooked while started, NULL after the last.
+  int running_steps; // Step processes of that task that haven't exited.
+  unsigned task_failed : 1; // A step of that task failed or couldn't start.
+  unsigned timed_out : 1;   // It was killed for running past its timeout.
+  int failed_step; // Rightmost step of that task that failed, -1 for none
+                   // (when its redirections or pipes couldn't be set up).
+  int exit_status; // Wait status of that step, -1 if it couldn't start.
+  pid_t* pids; // Pids of the steps of that task by position, 0 once reaped.
+  pid_t pgid;  // Process group of those steps, 0 if they aren't in their own.
+  long long timeout_us;  // Longest the recipe may take to cook, 0 for ever.
+  long long deadline_us; // When cooking it has to be over, if it has one.
+  int pipe_size; // Buffer size of the pipes between its steps, 0 for default.
+  int retries;  // Times the recipe may be cooked again after failing.
+  int attempts; // Times cooking the recipe has failed so far.
+  long long start_us; // When cooking started, on the monotonic clock.
+  int slots;          // Cooks the recipe occupies (its @slots hint).
+  long long memory;   // Bytes the recipe is expected to need (its @mem hint).
+  long cpu_us;        // User and system time of the steps reaped so far.
+  long max_rss_kb;    // Largest peak resident set size of those steps.
+  uint64_t task_hash; // Hash of the words and redirections of its tasks.
+  uint64_t cache_key; // task_hash combined with the dependencies' keys.
 } STATE;
 
 /**
- * @brief Gets all the nodes without any dependencies (leaf nodes)
+ * @brief The recipes reachable from the main recipe, flattened so that the
+ * scheduler works on array indices instead of chasing linked lists.
+ *
+ * Recipes are numbered 0..count-1 in topological order: every recipe comes
+ * after all of the recipes it depends on. The edges are stored in
+ * compressed sparse row form: the dependencies of recipe i are
+ * dependencies[dependencies_start[i]] up to (but not including)
+ * dependencies[dependencies_start[i + 1]], and likewise for its dependents.
+ * A dependency listed twice in a recipe header gives two edges.
+ *
+ * Filled in by get_all_leaves(); every array lives in the cookbook.
  *
- * @param start Root recipe
  */
-void
-get_all_leaves(RECIPE_LINK* start);
+typedef struct
+{
+  int count;               // Number of recipes.
+  RECIPE** recipes;        // Recipe with each index.
+  STATE* states;           // State of the recipe with each index.
+  int* dependencies_start; // count + 1 offsets into dependencies.
+  int* dependencies;       // Indices of the recipes each recipe depends on.
+  int* dependents_start;   // count + 1 offsets into dependents.
+  int* dependents;         // Indices of the recipes depending on each one.
+} GRAPH;
+
+extern GRAPH graph;
 
 /**
- * @brief Goes through every recipe in the RECIPE_LINK's depends on list
- * and checks if they are completed.
+ * @brief Walks every recipe reachable from root once, iteratively, and
+ * compiles them into graph, giving each one a state with its dependency
+ * count, the hash of its tasks (computed on a pool of threads), its
+ * estimated cost (from stats_estimate(), so stats_load() should
+ * be called first) and its priority: the total estimate of the longest
+ * chain of recipes from it up to root, itself included, so that the recipes
+ * holding up the longest (critical) path are cooked first. The work queue is then
+ * sized for all of them and the recipes without any dependencies (leaf
+ * nodes) are added to it.
  *
- * @param recipe
- * @return int
+ * While walking, the state pointer of each recipe in the cookbook is set to
+ * an int in the cookbook holding the recipe's index in graph (or a negative
+ * value if it is not reachable from root).
+ *
+ * Exits with an error if the recipes depend on each other in a cycle.
+ *
+ * @param cbp Cookbook the recipes belong to
+ * @param root Main recipe
  */
-int
-is_dependencies_completed(RECIPE_LINK* recipe);
+void
+get_all_leaves(COOKBOOK* cbp, RECIPE* root);
 
 /**
- * @brief Goes through all of the recipes in the
- * `recipe->recipe->depend_on_this` list and queues them to the work queue if
- * all their dependencies have been completed.
+ * @brief Goes through all of the recipes that depend on the given one,
+ * counts down their pending dependencies and queues the ones whose count
+ * reaches zero to the work queue.
+ * Every edge is visited once per completion, so each dependent is released
+ * exactly once, when its last dependency finishes.
  *
- * @param recipe
+ * @param id Index of the recipe that finished
  */
 void
-queue_recipes_from_depend_on_this_list(RECIPE_LINK* recipe);
+release_dependents(int id);
+
+/**
+ * @brief Marks every recipe that depends on the given one, directly or
+ * through other recipes, as skipped. Their pending counts never reach
+ * zero, so they are never queued; recipes that don't depend on it are not
+ * affected.
+ *
+ * @param id Index of the recipe that failed
+ * @return int The number of recipes newly skipped.
+ */
+int
+poison_dependents(int id);
 
 /**
  * @brief Counts the number of steps
@@ -67,10 +141,27 @@ queue_recipes_from_depend_on_this_list(RECIPE_LINK* recipe);
 int
 count_number_of_steps(STEP* steps);
 
-RECIPE*
-find_by_pid(pid_t pid);
+/**
+ * @brief Make-style up-to-date check. A recipe is up to date when all of its
+ * target files exist and none of its prerequisites (the targets of the
+ * recipes it depends on, and the input redirections of its tasks) are newer
+ * than the oldest of them. A dependency without a target file on disk, or a
+ * missing input redirection, always makes the recipe out of date.
+ *
+ * @param id Index of the recipe in graph
+ * @return int 1 if the recipe can be skipped, 0 if it has to be cooked.
+ */
+int
+is_recipe_up_to_date(int id);
 
+/**
+ * @brief Makes the recipe with the given name the main recipe.
+ * Exits with an error if the cookbook has no such recipe.
+ *
+ * @param cbp
+ * @param recipe_name
+ */
 void
-set_main_recipe(char* recipe_name);
+set_main_recipe(COOKBOOK* cbp, char* recipe_name);
 
 #endif
\ No newline at end of file
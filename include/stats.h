@@ -0,0 +1,69 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "cookbook.h"
+#include <stdint.h>
+
+#define STATS_FILE ".cook-stats"
+#define STATS_MAGIC "COOKST01"
+#define STATS_MAX_RECORDS 65536
+#define STATS_DEFAULT_STEP_US 100000 // Guess for a step that was never timed.
+
+/**
+ * @brief One cooked recipe in the history file. The file is STATS_MAGIC
+ * followed by these records, oldest first, and is only ever appended to
+ * (or, once it holds more than STATS_MAX_RECORDS, cut down to its newest
+ * half).
+ *
+ */
+typedef struct
+{
+  uint64_t name_hash;  // Hash of the recipe name.
+  uint64_t task_hash;  // Hash of the words and redirections of its tasks.
+  uint64_t wall_us;    // From starting its first step to reaping its last.
+  uint64_t cpu_us;     // User and system time of all of its steps.
+  uint64_t max_rss_kb; // Largest peak resident set size of any step.
+  uint64_t time;       // When it finished, in seconds since the epoch.
+} STATS_RECORD;
+
+/**
+ * @brief Maps STATS_FILE, if there is one, and indexes the wall times in
+ * it by recipe name and tasks. Recipes that were timed several times get
+ * an exponentially weighted average that favours recent runs.
+ *
+ */
+void
+stats_load();
+
+/**
+ * @brief Expected wall time of cooking a recipe, in microseconds: its
+ * average from the history if its tasks were timed before, otherwise
+ * STATS_DEFAULT_STEP_US for each of its steps.
+ *
+ * @param id Index of the recipe in graph, with its task_hash set
+ * @return long
+ */
+long
+stats_estimate(int id);
+
+/**
+ * @brief Remembers the cost of a recipe that was just cooked. The records
+ * are written out by stats_save().
+ *
+ * @param id Index of the recipe in graph
+ * @param wall_us
+ * @param cpu_us
+ * @param max_rss_kb
+ */
+void
+stats_record(int id, uint64_t wall_us, uint64_t cpu_us, uint64_t max_rss_kb);
+
+/**
+ * @brief Appends the recorded costs to STATS_FILE. Errors are ignored; they
+ * only cost worse estimates later.
+ *
+ */
+void
+stats_save();
+
+#endif
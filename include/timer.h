@@ -0,0 +1,81 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+/**
+ * @brief What the scheduler has to do when a timer expires.
+ *
+ */
+typedef enum
+{
+  TIMER_RETRY,  // Queue a failed recipe again.
+  TIMER_TIMEOUT // Kill a recipe that is still cooking past its deadline.
+} TIMER_KIND;
+
+/**
+ * @brief A point in time (on the monotonic clock, in microseconds) at which
+ * the scheduler has to come back to a recipe.
+ *
+ * Timers can't be cancelled: one that no longer applies (such as the
+ * timeout of a recipe that has finished) is ignored when it expires.
+ *
+ */
+typedef struct
+{
+  long long due_us;
+  int id; // Index of the recipe in graph.
+  TIMER_KIND kind;
+} TIMER;
+
+/**
+ * @brief Binary min-heap of the pending timers, earliest first. The event
+ * loop sleeps no longer than until the earliest one, so waiting on a timer
+ * never holds up the other recipes.
+ *
+ */
+typedef struct
+{
+  TIMER* timers;
+  int capacity;
+  int count;
+} TIMER_HEAP;
+
+/**
+ * @brief Sets a timer for a recipe.
+ *
+ * @param due_us When it expires
+ * @param id Index of the recipe in graph
+ * @param kind
+ */
+void
+timer_add(long long due_us, int id, TIMER_KIND kind);
+
+/**
+ * @brief Removes the earliest timer if it has expired.
+ *
+ * @param now_us The current time
+ * @param timer Where the removed timer is stored
+ * @return int 1 if a timer was removed, 0 if none has expired.
+ */
+int
+timer_expired(long long now_us, TIMER* timer);
+
+/**
+ * @brief Returns how long to sleep until the earliest timer expires,
+ * rounded up to whole milliseconds.
+ *
+ * @param now_us The current time
+ * @return int Milliseconds (0 if it has already expired), or -1 if there
+ * are no timers.
+ */
+int
+timer_wait_ms(long long now_us);
+
+/**
+ * @brief Returns 1 if no timers are pending.
+ *
+ * @return int
+ */
+int
+timer_is_empty();
+
+#endif
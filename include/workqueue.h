@@ -14,40 +14,96 @@ int MAX_COOKS;
 volatile sig_atomic_t ACTIVE_COOKS;
 
 /**
- * @brief Work queue. Queues the recipe to be completed
- * at the head.
+ * @brief Work queue of recipes that are ready to be cooked.
+ * Newly queued recipes wait in arrivals until the scheduler has checked
+ * whether they need cooking at all (see q_take_arrivals()); the ones that do
+ * go into a binary max-heap on the priority in each recipe's state (ties go
+ * to the lower index). Both are sized for every reachable recipe: a recipe
+ * is only ever queued once, so they can't overflow and nothing is allocated
+ * per operation.
  *
  */
 typedef struct workqueue
 {
-  RECIPE_LINK* recipe;
-  struct workqueue* next;
+  int* recipes;      // Heap of the indices of ready recipes.
+  int capacity;      // Number of slots in the heap.
+  int count;         // Number of recipes in the heap.
+  int* arrivals;     // Recipes queued since the last q_take_arrivals().
+  int arrival_count; // Number of recipes in arrivals.
 } QUEUE;
 
 /**
- * @brief Head queue node
+ * @brief Allocates the queue with room for capacity recipes.
  *
+ * @param capacity
  */
-QUEUE* q;
+void
+q_init(int capacity);
 
 /**
- * @brief Add a recipe to the head of the queue.
+ * @brief Adds a recipe to the arrivals of the queue.
+ * Recipes that were queued before are ignored, so each one is queued at
+ * most once.
  *
- * @param recipe
+ * @param id Index of the recipe in graph (see get_all_leaves())
  */
 void
-q_enqueue(RECIPE_LINK* recipe);
+q_enqueue(int id);
+
+/**
+ * @brief Moves the recipes queued since the last call into ids (which needs
+ * room for every recipe in graph). They are out of the queue until given
+ * back with q_insert().
+ *
+ * @param ids
+ * @return int Number of recipes moved.
+ */
+int
+q_take_arrivals(int* ids);
 
 /**
- * @brief Sets the recipe at the head of the queue to "finished"
- * and then tries to add all the recipes that depend on the recipe
- * at the head of the queue to the queue. It then removes the recipe
- * from the queue.
+ * @brief Puts a recipe taken with q_take_arrivals() in the heap, to wait
+ * for cooks.
  *
+ * @param id
  */
 void
+q_insert(int id);
+
+/**
+ * @brief Removes the ready recipe with the highest priority.
+ *
+ * @return int Index of the removed recipe, or -1 if the queue is empty.
+ */
+int
 q_dequeue();
 
+/**
+ * @brief Removes the ready recipe with the highest priority among those for
+ * which admit returns 1, leaving the others queued.
+ *
+ * The recipes admit turns away are set aside, and are only offered to it
+ * again on a call with rescan set (when room may have been made for them),
+ * so a blocked queue isn't searched all over on every call; recipes
+ * inserted in the meantime are always offered. If admit returns -1, no
+ * other recipe is offered until the next call.
+ *
+ * @param admit
+ * @param rescan
+ * @return int Index of the removed recipe, or -1 if none was admitted.
+ */
+int
+q_dequeue_if(int (*admit)(int id), int rescan);
+
+/**
+ * @brief Returns 1 if there are no recipes in the queue, counting the
+ * arrivals and the recipes set aside by q_dequeue_if().
+ *
+ * @return int
+ */
+int
+q_is_empty();
+
 void
 print_queue();
 
@@ -3,29 +3,108 @@
 #include <ctype.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "arena.h"
 #include "cookbook.h"
 #include "debug.h"
+#include "hashtable.h"
 
 static void unparse_recipe(RECIPE *rp, FILE *out);
 static void unparse_task(TASK *tp, FILE *out);
 static void unparse_step(STEP *sp, FILE *out);
 static void unparse_token(char *tok, FILE *out);
 
-static RECIPE *parse_recipe(FILE *in, int *err);
-static RECIPE *parse_recipe_header(FILE *in, int *err);
-static TASK *parse_task(FILE *in, int *err);
-static STEP *parse_step(FILE *in, int *err);
-static char *parse_token(FILE *in, int *err);
+static RECIPE *parse_recipe(int *err);
+static RECIPE *parse_recipe_header(int *err);
+static TASK *parse_task(int *err);
+static STEP *parse_step(int *err);
+static char *parse_token(int *err);
+static char *parse_quoted_word(char *start);
+static char *finish_word(char *start, size_t length);
 static int is_delim(int c);
 
+static void load_input(FILE *in);
+static void unload_input(FILE *in);
+
 static int set_dependencies(COOKBOOK *cbp);
 
-static RECIPE *get_recipe(COOKBOOK *cbp, char *name);
+static void build_index(COOKBOOK *cbp);
+static unsigned long hash_name(char *name);
+static int holds_name(const void *slot, const void *name);
+
+/*
+ * Private state of a parsed cookbook, kept in COOKBOOK::state.
+ * The index is a hash table of the recipes by name (see hashtable.h).
+ *
+ * Everything in the cookbook is allocated from its arenas and released
+ * together by free_cookbook().  Recipes, links and the memory handed out
+ * by cookbook_alloc() each get their own arena, so that walking the
+ * dependency graph touches densely packed memory; tasks, steps, word
+ * arrays and the index share another, and the text of tokens a third.
+ */
+struct cookbook_state {
+    RECIPE **index;
+    size_t index_size;
+    ARENA recipes;
+    ARENA links;
+    ARENA extra;
+    ARENA tasks;
+    ARENA strings;
+};
+
+static void *alloc_zeroed(ARENA *arena, size_t size);
+static RECIPE **index_slot(struct cookbook_state *state, char *name);
 
 static char *peek_token;
 static int lineno;
 
+/*
+ * The cookbook is tokenized out of a single buffer holding the whole input:
+ * the file is mapped into memory when possible, and otherwise read in large
+ * blocks.  Tokens are copied from the buffer into the cookbook's string
+ * arena, so the buffer is released as soon as parsing is done.
+ */
+#define READ_BLOCK_SIZE (64 * 1024)
+
+static char *scan_buf;     // Start of the buffer.
+static size_t scan_size;   // Size of the buffer (or of the mapping).
+static int scan_mapped;    // Whether the buffer is mapped or malloc'd.
+static char *scan_pos;     // Next character to be scanned.
+static char *scan_end;     // End of the input.
+static int scan_eof;       // Set once a read past the end was attempted,
+                           // as feof() is for a stream.
+static struct cookbook_state *pstate;  // Cookbook being parsed.
+static char *scratch;      // Buffer for words that need unquoting.
+static size_t scratch_max;
+static char **words;       // Buffer for the words of the step being parsed.
+static int words_max;
+
+/*
+ * Classes of characters, as seen by the tokenizer.
+ * Whitespace is what isspace() accepts in the "C" locale.
+ */
+enum { CC_WORD, CC_SPACE, CC_NEWLINE, CC_DELIM, CC_BACKSLASH };
+
+static const unsigned char char_class[256] = {
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\v'] = CC_SPACE,
+    ['\f'] = CC_SPACE, ['\r'] = CC_SPACE, ['\n'] = CC_NEWLINE,
+    ['<'] = CC_DELIM, ['>'] = CC_DELIM, ['|'] = CC_DELIM, [':'] = CC_DELIM,
+    ['\\'] = CC_BACKSLASH
+};
+
+#define CLASS(c) (char_class[(unsigned char)(c)])
+
+/*
+ * Delimiter tokens.  The tokenizer always returns these same strings for
+ * delimiters, so they can be told apart from quoted words such as "\|"
+ * by comparing pointers.
+ */
+static char lt_token[] = "<";
+static char gt_token[] = ">";
+static char vbar_token[] = "|";
+static char colon_token[] = ":";
 /*
  * Print a cookbook, in a format from which it can be parsed.
  */
@@ -47,7 +126,16 @@ static void unparse_recipe(RECIPE *rp, FILE *out) {
     RECIPE_LINK *link;
     for(link = rp->this_depends_on; link != NULL; link = link->next) {
 	unparse_token(link->name, out);
-	if(link->next != NULL)
+	if(link->next != NULL || rp->attributes != NULL)
+	    fprintf(out, " ");
+    }
+    RECIPE_ATTRIBUTE *ap;
+    for(ap = rp->attributes; ap != NULL; ap = ap->next) {
+	fprintf(out, "@");
+	unparse_token(ap->name, out);
+	fprintf(out, "=");
+	unparse_token(ap->value, out);
+	if(ap->next != NULL)
 	    fprintf(out, " ");
     }
     fprintf(out, "\n");
@@ -121,13 +209,17 @@ static void unparse_token(char *tok, FILE *out) {
 COOKBOOK *parse_cookbook(FILE *in, int *errp) {
     debug("***COOKBOOK");
     COOKBOOK *cbp = calloc(1, sizeof(COOKBOOK));
+    pstate = calloc(1, sizeof(struct cookbook_state));
+    cbp->state = pstate;
     *errp = 0;
     lineno = 1;
+    peek_token = NULL;
+    load_input(in);
     
     // A cookbook is a sequence of recipes.
     RECIPE *rp;
     RECIPE **last = &cbp->recipes;
-    while((rp = parse_recipe(in, errp)) != NULL) {
+    while((rp = parse_recipe(errp)) != NULL) {
 	*last = rp;
         last = &rp->next;
     }
@@ -135,28 +227,96 @@ COOKBOOK *parse_cookbook(FILE *in, int *errp) {
 	fprintf(stderr, "%d: I/O error reading cookbook\n", lineno);
 	(*errp)++;
     }
+    unload_input(in);
+    build_index(cbp);
     if(cbp->recipes == NULL || set_dependencies(cbp))
 	(*errp)++;
     return cbp;
 }
 
+/*
+ * Make the rest of the input stream available to the tokenizer.
+ *
+ * A regular file is mapped into memory; anything else (or a file that
+ * can't be mapped) is read in large blocks.  If a read error occurs,
+ * whatever was read before it is parsed and the stream's error indicator
+ * is left set.
+ */
+static void load_input(FILE *in) {
+    struct stat st;
+    int fd = fileno(in);
+    off_t offset = ftello(in);
+    scan_buf = NULL;
+    scan_size = 0;
+    scan_mapped = 0;
+    scan_eof = 0;
+
+    if(fd != -1 && offset != -1 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+       && st.st_size > offset) {
+	char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map != MAP_FAILED) {
+	    madvise(map, st.st_size, MADV_SEQUENTIAL);
+	    scan_buf = map;
+	    scan_size = st.st_size;
+	    scan_mapped = 1;
+	    scan_pos = map + offset;
+	    scan_end = map + st.st_size;
+	    return;
+	}
+    }
+
+    size_t length = 0;
+    size_t n;
+    scan_size = READ_BLOCK_SIZE;
+    scan_buf = malloc(scan_size);
+    while((n = fread(scan_buf + length, 1, scan_size - length, in)) > 0) {
+	length += n;
+	if(length == scan_size) {
+	    scan_size *= 2;
+	    scan_buf = realloc(scan_buf, scan_size);
+	}
+    }
+    scan_pos = scan_buf;
+    scan_end = scan_buf + length;
+}
+
+/*
+ * Release the input buffer.  A mapped file is treated as having been read
+ * to the end, as it would have been by stream input.
+ */
+static void unload_input(FILE *in) {
+    if(scan_mapped) {
+	munmap(scan_buf, scan_size);
+	fseeko(in, 0, SEEK_END);
+    } else {
+	free(scan_buf);
+    }
+    scan_buf = scan_pos = scan_end = NULL;
+    free(scratch);
+    scratch = NULL;
+    scratch_max = 0;
+    free(words);
+    words = NULL;
+    words_max = 0;
+}
+
 /*
  * Parse a recipe.
  *
  * Returns the recipe, or NULL if EOF is encountered or an error occurs.
  * In case of error, errno is set.
  */
-static RECIPE *parse_recipe(FILE *in, int *errp) {
+static RECIPE *parse_recipe(int *errp) {
     debug("***RECIPE");
     // A recipe consists of a header line, followed by a sequence of tasks.
-    RECIPE *rp = parse_recipe_header(in, errp);
+    RECIPE *rp = parse_recipe_header(errp);
     if(rp == NULL)
 	return NULL;
 
     // Parse the recipe tasks and link them into the cookbook.
     TASK *task;
     TASK **last = &rp->tasks;
-    while((task = parse_task(in, errp)) != NULL) {
+    while((task = parse_task(errp)) != NULL) {
 	*last = task;
 	last = &task->next;
     }
@@ -170,46 +330,54 @@ static RECIPE *parse_recipe(FILE *in, int *errp) {
  * Returns partially initialized recipe on success, NULL otherwise.
  * In case of error, errno is set.
  */
-static RECIPE *parse_recipe_header(FILE *in, int *errp) {
+static RECIPE *parse_recipe_header(int *errp) {
     debug("***RECIPE HEADER");
     // A recipe header consists of a name, followed by a colon as a word by itself,
-    // followed by a sequence of sub-recipe names.
+    // followed by a sequence of sub-recipe names.  Words of the form @name=value
+    // among them are attributes of the recipe rather than sub-recipes.
     //
     // Lines preceding the header that consist only of whitespace are skipped.
     char *w;
 
     // Skip any blank lines preceding the recipe.
-    while(!feof(in) && (w = parse_token(in, errp)) != NULL && *w == '\0')
-	free(w);
-    if(feof(in))
+    while(!scan_eof && (w = parse_token(errp)) != NULL && *w == '\0')
+	;
+    if(scan_eof)
 	return NULL;
 
     // At this point, w should contain the recipe name.
-    RECIPE *rp = calloc(1, sizeof(RECIPE));
+    RECIPE *rp = alloc_zeroed(&pstate->recipes, sizeof(RECIPE));
     rp->name = w;
 
     // Check for the colon that is supposed to follow.
-    if((w = parse_token(in, errp)) == NULL || strcmp(w, ":")) {
+    if((w = parse_token(errp)) == NULL || w != colon_token) {
 	fprintf(stderr, "%d: Expected ':' after recipe name '%s' but '%s' was seen.\n",
 		lineno, rp->name, w != NULL ? w : "(NULL)");
-	if(w != NULL)
-	    free(w);
 	(*errp)++;
 	return rp;
     }
-    free(w);
 
     // The remaining words are the names of sub-recipes.
     // Create links for them.
     RECIPE_LINK **last = &rp->this_depends_on;
-    while((w = parse_token(in, errp)) != NULL && *w != '\0') {
-	RECIPE_LINK *link = calloc(1, sizeof(RECIPE_LINK));
+    RECIPE_ATTRIBUTE **last_attribute = &rp->attributes;
+    while((w = parse_token(errp)) != NULL && *w != '\0') {
+	char *eq;
+	if(*w == '@' && (eq = strchr(w, '=')) != NULL && eq > w + 1) {
+	    RECIPE_ATTRIBUTE *ap = alloc_zeroed(&pstate->links, sizeof(RECIPE_ATTRIBUTE));
+	    *eq = '\0';
+	    ap->name = w + 1;
+	    ap->value = eq + 1;
+	    debug("(attribute '%s' = '%s')", ap->name, ap->value);
+	    *last_attribute = ap;
+	    last_attribute = &ap->next;
+	    continue;
+	}
+	RECIPE_LINK *link = alloc_zeroed(&pstate->links, sizeof(RECIPE_LINK));
 	link->name = w;
 	*last = link;
 	last = &link->next;
     }
-    if(w != NULL)
-	free(w);
 
     return rp;
 }
@@ -218,17 +386,20 @@ static RECIPE *parse_recipe_header(FILE *in, int *errp) {
  * Parse a task.
  *
  * Returns the task, or NULL if a blank line is seen.
+ * The task is built on the stack and only copied into the cookbook
+ * if it turns out to have steps.
  */
-static TASK *parse_task(FILE *in, int *errp) {
+static TASK *parse_task(int *errp) {
     debug("***TASK");
-    TASK *tp = calloc(1, sizeof(TASK));
+    TASK task = { NULL };
+    TASK *tp = &task;
 
     // A task consists of a sequence of steps to be run as a pipeline,
     // optionally followed by input and output redirections.
     STEP *sp;
     STEP **lastp = &tp->steps;
     int ends_with_vbar = 0;
-    while(!feof(in) && (sp = parse_step(in, errp)) != NULL) {
+    while(!scan_eof && (sp = parse_step(errp)) != NULL) {
 	// parse_step() stops when EOF, NL, |, <, or > is seen,
 	// and it leaves the delimiter token unread.
 	ends_with_vbar = 0;
@@ -237,40 +408,33 @@ static TASK *parse_task(FILE *in, int *errp) {
 	// Examine the delimiter that caused parse_step to stop.
 	// Check for redirections and pipelines that end with "|".
 	char *w;
-	while(!feof(in) && (w = parse_token(in, errp)) != NULL) {
+	while(!scan_eof && (w = parse_token(errp)) != NULL) {
 	    debug("(step delimiter: '%s')", w);
 	    if(*w == '\0') {
-		free(w);
 		break;
-	    } else if(!strcmp(w, "|")) {
+	    } else if(w == vbar_token) {
 		ends_with_vbar = 1;
-		free(w);
 		break;  // Parse another step.
-	    } else if(!strcmp(w, "<") || !strcmp(w, ">")) {
+	    } else if(w == lt_token || w == gt_token) {
 		// Input or output redirection -- get filename.
-		char *n = parse_token(in, errp);
+		char *n = parse_token(errp);
 		if(n == NULL) {
 		    fprintf(stderr, "%d: Missing filename in input or output redirection\n",
 			    lineno);
-		    free(w);
 		    (*errp)++;
-		    return tp;
+		    break;
 		}
 		debug("(redirect '%s')", n);
-		char **np = (*w == '<' ? &tp->input_file : &tp->output_file);
+		char **np = (w == lt_token ? &tp->input_file : &tp->output_file);
 		if(*np != NULL) {
 		    fprintf(stderr, "%d: Redundant input or output redirection\n", lineno);
-		    free(w);
-		    free(n);
 		    (*errp)++;
 		    continue;
 		}
 		*np = n;
-		free(w);
 	    } else {
 		// Shouldn't happen.
 		fprintf(stderr, "%d: Step terminated by unknown delimiter '%s'", lineno, w);
-		free(w);
 		(*errp)++;
 		break;
 	    }
@@ -285,38 +449,35 @@ static TASK *parse_task(FILE *in, int *errp) {
 	(*errp)++;
     }
     if(tp->steps == NULL) {
-	free(tp);
 	debug("(empty task -- end of recipe)");
 	return NULL;
     }
     debug("(end task)");
+    tp = arena_alloc(&pstate->tasks, sizeof(TASK));
+    *tp = task;
     return tp;
 }
 
 /*
  * Parse a step.
+ *
+ * The words are collected in a buffer that is reused from step to step,
+ * so the array of each step is allocated only once, at its final size.
  */
-static STEP *parse_step(FILE *in, int *errp) {
+static STEP *parse_step(int *errp) {
     debug("***STEP");
     // A step consists of a sequence of non-delimiter words.
     // Delimiters are "|", "<", and ">" in words by themselves.
-    STEP *sp = calloc(1, sizeof(STEP));
     char *w;
     int length = 0;
-    int max = 8;
-    sp->words = calloc(max, sizeof(char *));
-    while((w = parse_token(in, errp)) != NULL && *w != '\0') {
-	if(length >= max-1) {
-	    max *= 2;
-	    sp->words = realloc(sp->words, max * sizeof(char *));
-	}
-	if(!strcmp(w, "|") || !strcmp(w, "<") || !strcmp(w, ">")) {
-	    debug("(push back '%s')", w);
-	    peek_token = w;
+    while((w = parse_token(errp)) != NULL && *w != '\0') {
+	if(w == vbar_token || w == lt_token || w == gt_token)
 	    break;
-	} else {
-	    sp->words[length++] = w;
+	if(length == words_max) {
+	    words_max = words_max ? 2 * words_max : 64;
+	    words = realloc(words, words_max * sizeof(char *));
 	}
+	words[length++] = w;
     }
     if(w != NULL) {
 	debug("(push back '%s')", w);
@@ -326,17 +487,18 @@ static STEP *parse_step(FILE *in, int *errp) {
     }
     if(length == 0) {
 	// No step here
-	free(sp->words);
-	free(sp);
 	return NULL;
     }
     debug("(end step)");
+    STEP *sp = alloc_zeroed(&pstate->tasks, sizeof(STEP));
+    sp->words = arena_alloc(&pstate->tasks, (length + 1) * sizeof(char *));
+    memcpy(sp->words, words, length * sizeof(char *));
     sp->words[length] = NULL;
     return sp;
 }
 
 static int is_delim(int c) {
-    return c == '<' || c == '>' || c == '|' || c == ':';
+    return CLASS(c) == CC_DELIM;
 }
 
 /*
@@ -344,24 +506,23 @@ static int is_delim(int c) {
  *
  * Initial whitespace (other than newline) is skipped.
  * If a newline is seen, an empty token is returned.
- * If '<', '>', or '|' is seen, a single-character token is returned.
- * If EOF is encountered or an error occurs, NULL is returned.
- * In other cases, characters are read up to the next whitespace character
- * or EOF.  The character delimiting the end of the word is left in
- * the input stream.
+ * If '<', '>', '|' or ':' is seen, a single-character token is returned.
+ * If EOF is encountered, NULL is returned.
+ * In other cases, characters are read up to the next whitespace character,
+ * delimiter or EOF.  A delimiter or newline ending the word is left to
+ * become the next token.
  *
  * If '\' (backslash) is seen while reading a token, then any special meaning
  * of the next character is canceled, and that next character (without the
  * backslash) is included in the token.  The backslash character itself is
  * subject to this quoting behavior; thus two backslashes in a row result in
- * a single backslash in the token.
+ * a single backslash in the token.  A backslash at the end of a line or of
+ * the input is kept as is.
  *
- * The caller is responsible for freeing any non-NULL token returned.
+ * Tokens are owned by the cookbook (empty and delimiter tokens are
+ * constant strings) and must not be freed or modified by the caller.
  */
-static char *parse_token(FILE *in, int *errp) {
-    int c;
-    int bs = 0;  // Whether a backslash was just read.
-
+static char *parse_token(int *errp) {
     // Check for a previously read token that was pushed back.
     if(peek_token != NULL) {
 	char *w = peek_token;
@@ -372,132 +533,158 @@ static char *parse_token(FILE *in, int *errp) {
     }
 
     // Skip initial whitespace, stopping if a newline is encountered.
-    while((c = fgetc(in)) != EOF && isspace(c) && c != '\n')
-	;
-    if(c == EOF) {
+    while(scan_pos < scan_end && CLASS(*scan_pos) == CC_SPACE)
+	scan_pos++;
+    if(scan_pos == scan_end) {
 	debug("(EOF)");
+	scan_eof = 1;
 	return NULL;
     }
-    if(c == '\n') {
+    switch(CLASS(*scan_pos)) {
+    case CC_NEWLINE:
 	debug("(NL)");
+	scan_pos++;
 	lineno++;
-	return strdup("");
+	return "";
+    case CC_DELIM: {
+	// Delimiters at the beginning of a token result in a
+	// single-character token.
+	char *delim;
+	switch(*scan_pos++) {
+	case '<': delim = lt_token; break;
+	case '>': delim = gt_token; break;
+	case '|': delim = vbar_token; break;
+	default:  delim = colon_token; break;
+	}
+	debug("DELIM: '%s'", delim);
+	return delim;
+    }
     }
 
     // A word is a sequence of non-whitespace, non-special characters.
-    int length = 0;
-    int max = 8;
-    char *word = calloc(max, sizeof(char));
-    do {
-	// Ensure space for another character.
-	if(length >= max-1) {
-	    max *= 2;
-	    word = realloc(word, max * sizeof(char));
-	}
-	// Check for EOF.
-	if(c == EOF) {
-	    debug("(EOF)");
-	    if(bs) {
-		word[length++] = '\\';
-		word[length] = '\0';
-		debug("WORD: %s", word);
-		return word;
-	    }
-	}
-	// Check for newline.
-	if(c == '\n') {
-	    ungetc(c, in);
-	    if(bs) 
-		word[length++] = '\\';
-	    word[length] = '\0';
-	    debug("WORD: %s", word);
-	    return word;
-	}
-	// Check for backslash character.
-	if(c == '\\') {
-	    if(bs) {
-		debug("(BS:=0)");
-		bs = 0;
-	    } else {
-		debug("(BS:=1)");
-		bs = 1;
-		c = fgetc(in);
-		continue;
-	    }
-	}
-	// Check for delimiter characters.
-	// At the beginning of a token, these result in
-	// a single-character token.
-	// Elsewhere, they terminate the current token and become
-	// the first character of the next token.
-	if(!bs && is_delim(c)) {
-	    if(length == 0) {
-		char *delim = NULL;
-		if(c == '<')
-		    delim = strdup("<");
-		if(c == '>')
-		    delim = strdup(">");
-		if(c == '|')
-		    delim = strdup("|");
-		if(c == ':')
-		    delim = strdup(":");
-		debug("DELIM: '%s'", delim);
-		return delim;
-	    } else {
-		ungetc(c, in);  // Leave it for next time.
-		word[length] = '\0';
-		debug("WORD: %s", word);
-		return word;
-	    }
+    // Most words contain no backslashes and are copied straight from the
+    // input once their end has been found.
+    char *start = scan_pos;
+    while(scan_pos < scan_end && CLASS(*scan_pos) == CC_WORD)
+	scan_pos++;
+    if(scan_pos < scan_end && CLASS(*scan_pos) == CC_BACKSLASH)
+	return parse_quoted_word(start);
+    return finish_word(start, scan_pos - start);
+}
+
+/*
+ * Finish reading a word that contains backslashes, the first of which is
+ * at scan_pos.  The unquoted word is built in the scratch buffer.
+ */
+static char *parse_quoted_word(char *start) {
+    size_t length = scan_pos - start;
+    // Unquoting never makes the text longer.
+    while(scratch_max < length + 2) {
+	scratch_max = scratch_max ? 2 * scratch_max : 256;
+	scratch = realloc(scratch, scratch_max);
+    }
+    memcpy(scratch, start, length);
+    while(scan_pos < scan_end) {
+	int cc = CLASS(*scan_pos);
+	if(cc != CC_WORD && cc != CC_BACKSLASH)
+	    break;
+	if(length + 2 > scratch_max) {
+	    scratch_max *= 2;
+	    scratch = realloc(scratch, scratch_max);
 	}
-	// Check for space characters.
-	// These terminate the current token, but unless there is a
-	// preceding backslash they are never added to the token.
-	if(isspace(c)) {
-	    if(bs) {
-		debug("(BS:=0)");
-		bs = 0;
-		word[length++] = c;
-		c = fgetc(in);
-	    } else {
+	if(cc == CC_BACKSLASH) {
+	    if(scan_pos + 1 == scan_end || scan_pos[1] == '\n') {
+		// Nothing to quote: keep the backslash.
+		scratch[length++] = *scan_pos++;
 		break;
 	    }
+	    scan_pos++;
 	}
-	// Default case: add character to token.
-	word[length++] = c;
-	c = fgetc(in);
-    } while(c != EOF);
-    if(c != EOF && !isspace(c))
-	ungetc(c, in);  // Leave it for next time.
-
-    // Finish up.
-    word[length] = '\0';
-    if(length == 0) {
-	// Only whitespace was read.
-	debug("(EMPTY)");
-	free(word);
-	return strdup("");
+	scratch[length++] = *scan_pos++;
     }
+    return finish_word(scratch, length);
+}
+
+/*
+ * Copy a word into the cookbook's string arena.
+ */
+static char *finish_word(char *start, size_t length) {
+    char *word = arena_strndup(&pstate->strings, start, length);
+    if(scan_pos == scan_end)
+	scan_eof = 1;  // A stream would have hit EOF looking for the end.
     debug("WORD: %s", word);
     return word;
 }
 
 /*
- * Get the recipe with a given name from a cookbook.
+ * FNV-1a hash of a recipe name.
  */
+static unsigned long hash_name(char *name) {
+    unsigned long h = 14695981039346656037UL;
+    for(unsigned char *cp = (unsigned char *)name; *cp != '\0'; cp++) {
+	h ^= *cp;
+	h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/*
+ * Tell whether a slot of the name index is empty or holds a recipe with
+ * the given name.
+ */
+static int holds_name(const void *slot, const void *name) {
+    RECIPE *rp = *(RECIPE **)slot;
+    return rp == NULL || !strcmp(rp->name, name);
+}
 
-static RECIPE *get_recipe(COOKBOOK *cbp, char *name) {
-    /*
-     * We are just using inefficient linear search.
-     * If we want to do better, we could first create an index for
-     * the cookbook, in the form a of a hash table or sorted list of names
-     * that could be accessed using binary search.
-     */
-    for(RECIPE *rp = cbp->recipes; rp != NULL; rp = rp->next) {
-	if(!strcmp(rp->name, name))
-	    return rp;
-    }
-    return NULL;
+/*
+ * Find the slot of a name in the index of a cookbook.
+ */
+static RECIPE **index_slot(struct cookbook_state *state, char *name) {
+    return &state->index[hashtable_probe(state->index, sizeof(RECIPE *),
+					 state->index_size, hash_name(name),
+					 holds_name, name)];
+}
+
+/*
+ * Create the name index of a cookbook, so that recipes can be looked up
+ * without a linear search.  If several recipes have the same name, the
+ * first one is the one that is found, as it is in the list.
+ */
+static void build_index(COOKBOOK *cbp) {
+    struct cookbook_state *state = cbp->state;
+    size_t count = 0;
+    RECIPE *rp;
+    for(rp = cbp->recipes; rp != NULL; rp = rp->next)
+	count++;
+    state->index_size = hashtable_capacity(count, 2);
+    state->index = alloc_zeroed(&state->tasks,
+				state->index_size * sizeof(RECIPE *));
+    for(rp = cbp->recipes; rp != NULL; rp = rp->next) {
+	RECIPE **slot = index_slot(state, rp->name);
+	if(*slot == NULL)
+	    *slot = rp;
+    }
+}
+
+/*
+ * Get the recipe with a given name from a cookbook, using its index.
+ */
+RECIPE *find_recipe(COOKBOOK *cbp, char *name) {
+    return *index_slot(cbp->state, name);
+}
+
+/*
+ * Look up an attribute of a recipe.  Later attributes override earlier ones.
+ */
+char *recipe_attribute(RECIPE *rp, char *name) {
+    char *value = NULL;
+    RECIPE_ATTRIBUTE *ap;
+    for(ap = rp->attributes; ap != NULL; ap = ap->next) {
+	if(!strcmp(ap->name, name))
+	    value = ap->value;
+    }
+    return value;
 }
 
 /*
@@ -509,13 +696,14 @@ static RECIPE *get_recipe(COOKBOOK *cbp, char *name) {
  */
 
 static int set_dependencies(COOKBOOK *cbp) {
+    struct cookbook_state *state = cbp->state;
     RECIPE *rp, *sp;
     for(rp = cbp->recipes; rp != NULL; rp = rp->next) {
 	debug("set_dependencies: %s", rp->name);
 	RECIPE_LINK *rlp;
 	for(rlp = rp->this_depends_on; rlp != NULL; rlp = rlp->next) {
 	    debug("depends on: %s", rlp->name);
-	    sp = get_recipe(cbp, rlp->name);
+	    sp = find_recipe(cbp, rlp->name);
 	    if(sp == NULL) {
 		fprintf(stderr, "Recipe %s depends on non-existent sub-recipe %s\n",
 			rp->name, rlp->name);
@@ -523,7 +711,7 @@ static int set_dependencies(COOKBOOK *cbp) {
 	    }
 	    debug("Set dependency: %s -> %s", rp->name, sp->name);
 	    rlp->recipe = sp;
-	    RECIPE_LINK *rlp1 = calloc(1, sizeof(RECIPE_LINK));
+	    RECIPE_LINK *rlp1 = alloc_zeroed(&state->links, sizeof(RECIPE_LINK));
 	    rlp1->name = rp->name;
 	    rlp1->recipe = rp;
 	    rlp1->next = sp->depend_on_this;
@@ -532,3 +720,36 @@ static int set_dependencies(COOKBOOK *cbp) {
     }
     return 0;
 }
+
+/*
+ * Allocate cleared memory from one of the cookbook's arenas.
+ */
+static void *alloc_zeroed(ARENA *arena, size_t size) {
+    void *p = arena_alloc(arena, size);
+    memset(p, 0, size);
+    return p;
+}
+
+/*
+ * Allocate cleared memory that lives as long as the cookbook.
+ */
+void *cookbook_alloc(COOKBOOK *cbp, size_t size) {
+    struct cookbook_state *state = cbp->state;
+    return alloc_zeroed(&state->extra, size);
+}
+
+/*
+ * Free a cookbook and everything that was allocated for it.
+ */
+void free_cookbook(COOKBOOK *cbp) {
+    struct cookbook_state *state = cbp->state;
+    if(state != NULL) {
+	arena_free(&state->recipes);
+	arena_free(&state->links);
+	arena_free(&state->extra);
+	arena_free(&state->tasks);
+	arena_free(&state->strings);
+	free(state);
+    }
+    free(cbp);
+}
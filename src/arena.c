@@ -0,0 +1,82 @@
+#include "arena.h"
+#include "debug.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+static ARENA_BLOCK*
+new_block(ARENA* arena, size_t size)
+{
+  if (size < ARENA_BLOCK_SIZE)
+    size = ARENA_BLOCK_SIZE;
+  ARENA_BLOCK* block = malloc(sizeof(ARENA_BLOCK) + size);
+  if (block == NULL) {
+    error("Out of memory!");
+    exit(EXIT_FAILURE);
+  }
+  block->size = size;
+  block->used = 0;
+  block->next = arena->blocks;
+  arena->blocks = block;
+  return block;
+}
+
+static size_t
+padding(char* p, size_t align)
+{
+  return (align - ((uintptr_t)p & (align - 1))) & (align - 1);
+}
+
+static void*
+bump(ARENA* arena, size_t size, size_t align)
+{
+  ARENA_BLOCK* block = arena->blocks;
+  size_t start = 0;
+  if (block != NULL)
+    start = block->used + padding(block->data + block->used, align);
+  if (block == NULL || start + size > block->size) {
+    // Room for the padding is reserved as well, since a new block's data
+    // is only aligned as far as malloc() aligns the block itself.
+    block = new_block(arena, size + align);
+    start = padding(block->data, align);
+  }
+  block->used = start + size;
+  return block->data + start;
+}
+
+void*
+arena_alloc(ARENA* arena, size_t size)
+{
+  return bump(arena, size, alignof(max_align_t));
+}
+
+char*
+arena_alloc_chars(ARENA* arena, size_t len)
+{
+  return bump(arena, len, 1);
+}
+
+char*
+arena_strndup(ARENA* arena, const char* str, size_t len)
+{
+  char* copy = bump(arena, len + 1, 1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+void
+arena_free(ARENA* arena)
+{
+  ARENA_BLOCK* block = arena->blocks;
+  while (block != NULL) {
+    ARENA_BLOCK* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->blocks = NULL;
+}
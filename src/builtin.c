@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include "builtin.h"
+#include "command.h"
+#include "pipeline_utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief A command that can run inside cook. It only takes the given
+ * option (if any), which has to come first.
+ *
+ */
+typedef struct
+{
+  char* name;
+  char* option;
+  int (*run)(char** args, int out);
+} BUILTIN;
+
+static int
+builtin_rm(char** args, int out)
+{
+  int status = 0;
+  for (; *args != NULL; args++) {
+    if (unlink(*args) == -1 && errno != ENOENT) {
+      fprintf(stderr, "rm: cannot remove '%s': %s\n", *args, strerror(errno));
+      status = 1;
+    }
+  }
+  return status;
+}
+
+static int
+make_directory(char* path)
+{
+  struct stat st;
+  if (mkdir(path, 0777) == 0)
+    return 0;
+  if (errno == EEXIST && stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+    return 0;
+  if (errno == EEXIST)
+    errno = ENOTDIR;
+  return -1;
+}
+
+static int
+builtin_mkdir(char** args, int out)
+{
+  int status = 0;
+  for (; *args != NULL; args++) {
+    char* path = strdup(*args);
+    int err = 0;
+    // Make every parent first, then the directory itself.
+    for (char* slash = strchr(path, '/'); slash != NULL && err == 0;
+         slash = strchr(slash + 1, '/')) {
+      if (slash == path)
+        continue;
+      *slash = '\0';
+      err = make_directory(path);
+      *slash = '/';
+    }
+    if (err == 0)
+      err = make_directory(path);
+    if (err == -1) {
+      fprintf(stderr, "mkdir: cannot create directory '%s': %s\n", *args,
+              strerror(errno));
+      status = 1;
+    }
+    free(path);
+  }
+  return status;
+}
+
+static int
+builtin_touch(char** args, int out)
+{
+  int status = 0;
+  for (; *args != NULL; args++) {
+    int fd = open(*args, O_WRONLY | O_CREAT | O_NONBLOCK | O_NOCTTY, 0666);
+    int err = fd == -1 ? utimensat(AT_FDCWD, *args, NULL, 0)
+                       : futimens(fd, NULL);
+    if (fd != -1)
+      close(fd);
+    if (err == -1) {
+      fprintf(stderr, "touch: cannot touch '%s': %s\n", *args,
+              strerror(errno));
+      status = 1;
+    }
+  }
+  return status;
+}
+
+static int
+builtin_cp(char** args, int out)
+{
+  struct stat from, to;
+  char* target = args[1];
+  char* path = NULL;
+
+  // Leave anything unusual, and its error messages, to the real cp.
+  if (args[0] == NULL || args[1] == NULL || args[2] != NULL ||
+      stat(args[0], &from) == -1 || !S_ISREG(from.st_mode) ||
+      from.st_size > BUILTIN_MAX_COPY)
+    return -1;
+  if (stat(target, &to) == 0 && S_ISDIR(to.st_mode)) {
+    char* name = strrchr(args[0], '/');
+    name = name == NULL ? args[0] : name + 1;
+    path = malloc(strlen(target) + strlen(name) + 2);
+    sprintf(path, "%s/%s", target, name);
+    target = path;
+  }
+  if (stat(target, &to) == 0 &&
+      (to.st_dev == from.st_dev && to.st_ino == from.st_ino)) {
+    free(path);
+    return -1;
+  }
+
+  int status = 1;
+  int in = open(args[0], O_RDONLY);
+  int fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, from.st_mode & 0777);
+  if (in == -1)
+    fprintf(stderr, "cp: cannot open '%s' for reading: %s\n", args[0],
+            strerror(errno));
+  else if (fd == -1)
+    fprintf(stderr, "cp: cannot create regular file '%s': %s\n", target,
+            strerror(errno));
+  else if (copy_contents(in, fd) == -1)
+    fprintf(stderr, "cp: error copying '%s' to '%s': %s\n", args[0], target,
+            strerror(errno));
+  else
+    status = 0;
+  if (in != -1)
+    close(in);
+  if (fd != -1 && close(fd) == -1 && status == 0) {
+    fprintf(stderr, "cp: error writing '%s': %s\n", target, strerror(errno));
+    status = 1;
+  }
+  free(path);
+  return status;
+}
+
+static int
+builtin_echo(char** args, int out)
+{
+  size_t size = 1;
+  // Writing to cook's own output is left to a process: it may be a pipe
+  // whose reader has gone away.
+  if (out == -1)
+    return -1;
+  for (char** arg = args; *arg != NULL; arg++)
+    size += strlen(*arg) + 1;
+
+  char* line = malloc(size);
+  char* end = line;
+  for (char** arg = args; *arg != NULL; arg++) {
+    if (arg != args)
+      *end++ = ' ';
+    end = stpcpy(end, *arg);
+  }
+  *end++ = '\n';
+  int status = 0;
+  if (write_all(out, line, end - line) == -1) {
+    fprintf(stderr, "echo: write error: %s\n", strerror(errno));
+    status = 1;
+  }
+  free(line);
+  return status;
+}
+
+static BUILTIN builtins[] = {
+  { "rm", "-f", builtin_rm },       { "mkdir", "-p", builtin_mkdir },
+  { "touch", NULL, builtin_touch }, { "cp", NULL, builtin_cp },
+  { "echo", NULL, builtin_echo },
+};
+
+int
+run_builtin(STEP* step, int out)
+{
+  char** args = step->words + 1;
+  BUILTIN* builtin = NULL;
+
+  for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+    if (strcmp(step->words[0], builtins[i].name) == 0)
+      builtin = &builtins[i];
+  }
+  if (builtin == NULL)
+    return -1;
+  if (builtin->option != NULL) {
+    if (*args == NULL || strcmp(*args, builtin->option) != 0)
+      return -1;
+    args++;
+  }
+  for (char** arg = args; *arg != NULL; arg++) {
+    if ((*arg)[0] == '-')
+      return -1;
+  }
+  if (!is_system_command(step->words[0]))
+    return -1;
+  return builtin->run(args, out);
+}
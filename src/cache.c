@@ -0,0 +1,179 @@
+#include "cache.h"
+#include "debug.h"
+#include "hash.h"
+#include "parallel.h"
+#include "pipeline_utils.h"
+#include "recipe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_SEED 0x636f6f6bULL
+
+static int enabled;
+
+void
+cache_enable()
+{
+  enabled = 1;
+}
+
+int
+cache_enabled()
+{
+  return enabled;
+}
+
+static void
+hash_file(HASH_STATE* hs, char* path)
+{
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+      hash_update(hs, data, st.st_size);
+      munmap(data, st.st_size);
+    }
+  }
+  close(fd);
+}
+
+static void
+compute_key(int i, void* arg)
+{
+  int id = ((int*)arg)[i];
+  STATE* state = &graph.states[id];
+  HASH_STATE hs;
+
+  hash_init(&hs, CACHE_SEED);
+  hash_update(&hs, &state->task_hash, sizeof(state->task_hash));
+  // The recipes this one depends on are done, so the files they generate
+  // are hashed as they are now.
+  for (TASK* task = graph.recipes[id]->tasks; task != NULL; task = task->next) {
+    if (task->input_file != NULL)
+      hash_file(&hs, task->input_file);
+  }
+  for (int j = graph.dependencies_start[id];
+       j < graph.dependencies_start[id + 1];
+       j++) {
+    uint64_t key = graph.states[graph.dependencies[j]].cache_key;
+    hash_update(&hs, &key, sizeof(key));
+  }
+  state->cache_key = hash_final(&hs);
+}
+
+void
+cache_compute_keys(int* ids, int count)
+{
+  if (enabled)
+    parallel_for(count, compute_key, ids);
+}
+
+static int
+has_outputs(RECIPE* recipe)
+{
+  for (TASK* task = recipe->tasks; task != NULL; task = task->next) {
+    if (task->output_file != NULL)
+      return 1;
+  }
+  return 0;
+}
+
+static void
+entry_path(char* buf, size_t size, int id)
+{
+  snprintf(buf, size, "%s/%016" PRIx64, CACHE_DIR, graph.states[id].cache_key);
+}
+
+static int
+copy_file(char* from, char* to)
+{
+  int in = open(from, O_RDONLY);
+  if (in == -1)
+    return -1;
+  int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out == -1) {
+    close(in);
+    return -1;
+  }
+  int ret = copy_contents(in, out);
+  close(in);
+  if (close(out) == -1)
+    ret = -1;
+  return ret;
+}
+
+int
+cache_restore(int id)
+{
+  char dir[sizeof(CACHE_DIR) + 32];
+  char path[sizeof(dir) + 16];
+  struct stat st;
+  RECIPE* recipe = graph.recipes[id];
+
+  if (!enabled || !has_outputs(recipe))
+    return 0;
+  entry_path(dir, sizeof(dir), id);
+  if (stat(dir, &st) == -1)
+    return 0;
+
+  int i = 0;
+  for (TASK* task = recipe->tasks; task != NULL; task = task->next, i++) {
+    if (task->output_file == NULL)
+      continue;
+    snprintf(path, sizeof(path), "%s/%d", dir, i);
+    if (copy_file(path, task->output_file) == -1) {
+      warn("Cache entry %s is incomplete", dir);
+      return 0;
+    }
+  }
+  debug("Restored %s from %s", recipe->name, dir);
+  return 1;
+}
+
+void
+cache_store(int id)
+{
+  char dir[sizeof(CACHE_DIR) + 32];
+  char tmp[sizeof(dir) + 16];
+  char path[sizeof(tmp) + 16];
+  RECIPE* recipe = graph.recipes[id];
+
+  if (!enabled || !has_outputs(recipe))
+    return;
+  entry_path(dir, sizeof(dir), id);
+  snprintf(tmp, sizeof(tmp), "%s.%d", dir, (int)getpid());
+  if ((mkdir(CACHE_DIR, 0777) == -1 && errno != EEXIST) ||
+      mkdir(tmp, 0777) == -1)
+    return;
+
+  int i = 0;
+  for (TASK* task = recipe->tasks; task != NULL; task = task->next, i++) {
+    if (task->output_file == NULL)
+      continue;
+    snprintf(path, sizeof(path), "%s/%d", tmp, i);
+    if (copy_file(task->output_file, path) == -1)
+      goto discard;
+  }
+  // Entries are published atomically; if another cook got there first its
+  // entry is identical, so ours is dropped.
+  if (rename(tmp, dir) == 0)
+    return;
+discard:
+  i = 0;
+  for (TASK* task = recipe->tasks; task != NULL; task = task->next, i++) {
+    snprintf(path, sizeof(path), "%s/%d", tmp, i);
+    unlink(path);
+  }
+  rmdir(tmp);
+}
@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include "command.h"
+#include "hash.h"
+#include "hashtable.h"
+#include "parallel.h"
+#include "recipe.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define COMMAND_SEED 0x636d6473ULL
+#define COMMANDS_MIN_CAPACITY 64
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+/**
+ * @brief A command name and the program it resolves to. path is NULL if
+ * nothing was found (or the name hasn't been resolved yet).
+ *
+ */
+typedef struct
+{
+  char* name; // NULL marks an empty slot.
+  char* path;
+  uint64_t hash;
+  unsigned resolved : 1;
+  unsigned reported : 1;
+} COMMAND;
+
+static COMMAND* slots;
+static int capacity; // Always a power of two.
+static int count;
+
+static int
+is_executable(char* path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+static char*
+join(const char* dir, size_t dir_length, const char* name)
+{
+  size_t name_length = strlen(name);
+  char* path = malloc(dir_length + name_length + 2);
+  memcpy(path, dir, dir_length);
+  if (dir_length > 0 && dir[dir_length - 1] != '/')
+    path[dir_length++] = '/';
+  memcpy(path + dir_length, name, name_length + 1);
+  return path;
+}
+
+static char*
+search(char* name)
+{
+  char* path = join(UTIL_DIRECTORY, strlen(UTIL_DIRECTORY), name);
+  if (is_executable(path))
+    return path;
+  free(path);
+  if (strchr(name, '/') != NULL)
+    return strdup(name);
+
+  const char* dirs = getenv("PATH");
+  if (dirs == NULL)
+    dirs = DEFAULT_PATH;
+  for (;;) {
+    const char* end = strchrnul(dirs, ':');
+    // An empty entry stands for the current directory.
+    path = end == dirs ? join(".", 1, name) : join(dirs, end - dirs, name);
+    if (is_executable(path))
+      return path;
+    free(path);
+    if (*end == '\0')
+      return NULL;
+    dirs = end + 1;
+  }
+}
+
+static int
+holds(const void* slot, const void* key)
+{
+  const COMMAND* command = slot;
+  const COMMAND* wanted = key;
+  return command->name == NULL || (command->hash == wanted->hash &&
+                                   strcmp(command->name, wanted->name) == 0);
+}
+
+static COMMAND*
+find_slot(char* name, uint64_t hash)
+{
+  COMMAND key = { name, NULL, hash };
+  return &slots[hashtable_probe(slots, sizeof(COMMAND), capacity, hash, holds,
+                                &key)];
+}
+
+static void
+grow()
+{
+  COMMAND* old = slots;
+  int old_capacity = capacity;
+
+  capacity = capacity ? capacity * 2 : COMMANDS_MIN_CAPACITY;
+  slots = calloc(capacity, sizeof(COMMAND));
+  for (int i = 0; i < old_capacity; i++) {
+    if (old[i].name != NULL)
+      *find_slot(old[i].name, old[i].hash) = old[i];
+  }
+  free(old);
+}
+
+/**
+ * @brief Finds the slot of a name, adding it (unresolved) if it is new.
+ */
+static COMMAND*
+add_name(char* name)
+{
+  HASH_STATE hs;
+  hash_init(&hs, COMMAND_SEED);
+  hash_string(&hs, name);
+  uint64_t hash = hash_final(&hs);
+
+  if (capacity == 0)
+    grow();
+  COMMAND* command = find_slot(name, hash);
+  if (command->name != NULL)
+    return command;
+
+  if (hashtable_capacity(count + 1, COMMANDS_MIN_CAPACITY) >
+      (size_t)capacity) {
+    grow();
+    command = find_slot(name, hash);
+  }
+  *command = (COMMAND){ name, NULL, hash };
+  count++;
+  return command;
+}
+
+char*
+resolve_command(char* name)
+{
+  COMMAND* command = add_name(name);
+  if (!command->resolved) {
+    command->path = search(name);
+    command->resolved = 1;
+  }
+  return command->path;
+}
+
+static void
+resolve_slot(int i, void* arg)
+{
+  COMMAND* command = &slots[((int*)arg)[i]];
+  command->path = search(command->name);
+  command->resolved = 1;
+}
+
+int
+resolve_commands()
+{
+  for (int i = 0; i < graph.count; i++) {
+    for (TASK* task = graph.recipes[i]->tasks; task != NULL; task = task->next) {
+      for (STEP* step = task->steps; step != NULL; step = step->next)
+        add_name(step->words[0]);
+    }
+  }
+  if (count == 0)
+    return 0;
+
+  // The table doesn't change from here on, so the slots can be filled in
+  // from several threads.
+  int* pending = malloc(count * sizeof(int));
+  int pending_count = 0;
+  for (int i = 0; i < capacity; i++) {
+    if (slots[i].name != NULL && !slots[i].resolved)
+      pending[pending_count++] = i;
+  }
+  parallel_for(pending_count, resolve_slot, pending);
+  free(pending);
+
+  int missing = 0;
+  for (int i = 0; i < graph.count; i++) {
+    for (TASK* task = graph.recipes[i]->tasks; task != NULL; task = task->next) {
+      for (STEP* step = task->steps; step != NULL; step = step->next) {
+        COMMAND* command = add_name(step->words[0]);
+        if (command->path != NULL || command->reported)
+          continue;
+        fprintf(stderr, "Command '%s' needed by recipe '%s' not found\n",
+                command->name, graph.recipes[i]->name);
+        command->reported = 1;
+        missing++;
+      }
+    }
+  }
+  return missing;
+}
+
+int
+is_system_command(char* name)
+{
+  char* path = resolve_command(name);
+  return path != NULL &&
+         strncmp(path, UTIL_DIRECTORY, sizeof(UTIL_DIRECTORY) - 1) != 0;
+}
+
+int
+is_pass_through(STEP* step)
+{
+  return strcmp(step->words[0], "cat") == 0 && step->words[1] == NULL &&
+         is_system_command(step->words[0]);
+}
@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+#include "concurrency.h"
+#include "debug.h"
+#include "jobserver.h"
+#include "recipe.h"
+#include "workqueue.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static int automatic;
+static double max_load;
+static int base_cooks;         // Most cooks to use.
+static long long next_sample;  // Monotonic time of the next sample, in ms.
+static long long memory_budget;
+static long long memory_in_use;
+static int room_made; // Set when recipes turned away may fit now.
+
+static long long
+now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int
+cpu_count()
+{
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+    return CPU_COUNT(&set);
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+/**
+ * @brief Reads a number from the start of a /proc file with fscanf().
+ *
+ * @return int 1 if the file could be read and matched format.
+ */
+static int
+read_proc_number(char* path, char* format, double* value)
+{
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return 0;
+  int found = fscanf(f, format, value) == 1;
+  fclose(f);
+  return found;
+}
+
+void
+concurrency_auto()
+{
+  automatic = 1;
+}
+
+void
+concurrency_max_load(double load)
+{
+  max_load = load;
+}
+
+void
+concurrency_start()
+{
+  base_cooks = automatic ? cpu_count() : MAX_COOKS;
+  MAX_COOKS = base_cooks;
+  next_sample = 0;
+}
+
+int
+concurrency_adaptive()
+{
+  return automatic || max_load > 0;
+}
+
+void
+adjust_concurrency()
+{
+  double load, pressure;
+
+  if (!concurrency_adaptive() || now_ms() < next_sample)
+    return;
+  next_sample = now_ms() + CONCURRENCY_INTERVAL_MS;
+
+  int cooks = automatic ? cpu_count() : base_cooks;
+  if (max_load > 0 && read_proc_number("/proc/loadavg", "%lf", &load)) {
+    // The load average counts our own running steps too.
+    int room = (int)(max_load - (load - ACTIVE_COOKS));
+    if (room < cooks)
+      cooks = room;
+  }
+  if (read_proc_number("/proc/pressure/cpu", "some avg10=%lf", &pressure) &&
+      pressure >= CPU_PRESSURE_HIGH && cooks > ACTIVE_COOKS)
+    cooks = ACTIVE_COOKS;
+  if (cooks < 1)
+    cooks = 1;
+  if (cooks != MAX_COOKS)
+    info("Cooks %d -> %d", MAX_COOKS, cooks);
+  if (cooks > MAX_COOKS)
+    room_made = 1;
+  MAX_COOKS = cooks;
+}
+
+void
+concurrency_memory_budget(long long budget)
+{
+  memory_budget = budget;
+}
+
+long long
+parse_size(char* text)
+{
+  char* end;
+  long long size;
+
+  errno = 0;
+  size = strtoll(text, &end, 10);
+  if (end == text || errno != 0 || size < 0)
+    return -1;
+  switch (*end) {
+    case 'T':
+    case 't':
+      size *= 1024;
+      // fall through
+    case 'G':
+    case 'g':
+      size *= 1024;
+      // fall through
+    case 'M':
+    case 'm':
+      size *= 1024;
+      // fall through
+    case 'K':
+    case 'k':
+      size *= 1024;
+      end++;
+      break;
+  }
+  return *end == '\0' ? size : -1;
+}
+
+void
+read_recipe_hints()
+{
+  for (int i = 0; i < graph.count; i++) {
+    RECIPE* recipe = graph.recipes[i];
+    STATE* state = &graph.states[i];
+    char* slots = recipe_attribute(recipe, "slots");
+    char* memory = recipe_attribute(recipe, "mem");
+
+    state->slots = 1;
+    if (slots != NULL && (state->slots = atoi(slots)) < 1) {
+      fprintf(stderr, "Recipe %s: bad @slots=%s\n", recipe->name, slots);
+      exit(EXIT_FAILURE);
+    }
+    if (memory != NULL && (state->memory = parse_size(memory)) == -1) {
+      fprintf(stderr, "Recipe %s: bad @mem=%s\n", recipe->name, memory);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+int
+concurrency_admit(int id)
+{
+  STATE* state = &graph.states[id];
+  if (ACTIVE_COOKS == 0)
+    return 1;
+  if (ACTIVE_COOKS > MAX_COOKS - state->slots)
+    return 0;
+  if (memory_budget != 0 && memory_in_use + state->memory > memory_budget)
+    return 0;
+  // One of the cooks runs on the implicit token. No other recipe can get a
+  // token either once the pool ran dry.
+  return jobserver_acquire(ACTIVE_COOKS + state->slots - 1) ? 1 : -1;
+}
+
+void
+concurrency_started(int id)
+{
+  ACTIVE_COOKS += graph.states[id].slots;
+  memory_in_use += graph.states[id].memory;
+}
+
+void
+concurrency_finished(int id)
+{
+  ACTIVE_COOKS -= graph.states[id].slots;
+  memory_in_use -= graph.states[id].memory;
+  jobserver_release(ACTIVE_COOKS > 0 ? ACTIVE_COOKS - 1 : 0);
+  room_made = 1;
+}
+
+void
+concurrency_tokens_returned()
+{
+  jobserver_refilled();
+  room_made = 1;
+}
+
+int
+concurrency_room_changed()
+{
+  int changed = room_made;
+  room_made = 0;
+  return changed;
+}
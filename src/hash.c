@@ -0,0 +1,139 @@
+#include "hash.h"
+
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t
+read64(const unsigned char* p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t
+read32(const unsigned char* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t
+round64(uint64_t acc, uint64_t input)
+{
+  acc += input * PRIME64_2;
+  acc = ROTL64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static uint64_t
+merge_round(uint64_t acc, uint64_t val)
+{
+  acc ^= round64(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+void
+hash_init(HASH_STATE* state, uint64_t seed)
+{
+  memset(state, 0, sizeof(HASH_STATE));
+  state->seed = seed;
+  state->v[0] = seed + PRIME64_1 + PRIME64_2;
+  state->v[1] = seed + PRIME64_2;
+  state->v[2] = seed;
+  state->v[3] = seed - PRIME64_1;
+}
+
+void
+hash_update(HASH_STATE* state, const void* data, size_t len)
+{
+  const unsigned char* p = data;
+  const unsigned char* end = p + len;
+  state->total_len += len;
+
+  if (state->memsize + len < 32) {
+    memcpy(state->mem + state->memsize, p, len);
+    state->memsize += len;
+    return;
+  }
+  if (state->memsize > 0) {
+    size_t fill = 32 - state->memsize;
+    memcpy(state->mem + state->memsize, p, fill);
+    for (int i = 0; i < 4; i++)
+      state->v[i] = round64(state->v[i], read64(state->mem + i * 8));
+    p += fill;
+    state->memsize = 0;
+  }
+  uint64_t v0 = state->v[0], v1 = state->v[1], v2 = state->v[2],
+           v3 = state->v[3];
+  while (end - p >= 32) {
+    v0 = round64(v0, read64(p));
+    v1 = round64(v1, read64(p + 8));
+    v2 = round64(v2, read64(p + 16));
+    v3 = round64(v3, read64(p + 24));
+    p += 32;
+  }
+  state->v[0] = v0;
+  state->v[1] = v1;
+  state->v[2] = v2;
+  state->v[3] = v3;
+  if (p < end) {
+    memcpy(state->mem, p, end - p);
+    state->memsize = end - p;
+  }
+}
+
+void
+hash_string(HASH_STATE* state, const char* str)
+{
+  hash_update(state, str, strlen(str) + 1);
+}
+
+uint64_t
+hash_final(HASH_STATE* state)
+{
+  uint64_t h;
+  const unsigned char* p = state->mem;
+  const unsigned char* end = p + state->memsize;
+
+  if (state->total_len >= 32) {
+    h = ROTL64(state->v[0], 1) + ROTL64(state->v[1], 7) +
+        ROTL64(state->v[2], 12) + ROTL64(state->v[3], 18);
+    for (int i = 0; i < 4; i++)
+      h = merge_round(h, state->v[i]);
+  } else {
+    h = state->seed + PRIME64_5;
+  }
+  h += state->total_len;
+
+  while (end - p >= 8) {
+    h ^= round64(0, read64(p));
+    h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+  if (end - p >= 4) {
+    h ^= (uint64_t)read32(p) * PRIME64_1;
+    h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= (*p) * PRIME64_5;
+    h = ROTL64(h, 11) * PRIME64_1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
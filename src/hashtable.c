@@ -0,0 +1,25 @@
+#include "hashtable.h"
+
+size_t
+hashtable_capacity(size_t count, size_t min)
+{
+  size_t capacity = min;
+  while (capacity < 2 * count)
+    capacity *= 2;
+  return capacity;
+}
+
+size_t
+hashtable_probe(const void* slots,
+                size_t slot_size,
+                size_t capacity,
+                uint64_t hash,
+                int (*stop)(const void* slot, const void* key),
+                const void* key)
+{
+  const char* base = slots;
+  size_t i = hash & (capacity - 1);
+  while (!stop(base + i * slot_size, key))
+    i = (i + 1) & (capacity - 1);
+  return i;
+}
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include "jobserver.h"
+#include "concurrency.h"
+#include "debug.h"
+#include "workqueue.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int read_fd = -1;  // Private nonblocking descriptor to take tokens.
+static int write_fd = -1; // Descriptor to give tokens back.
+static char* tokens;      // The tokens held, to be given back as they were.
+static int held;
+static int max_held;
+static int starved;       // Set if the last jobserver_acquire() failed.
+
+/**
+ * @brief Opens a private nonblocking description of the pipe behind fd.
+ */
+static int
+reopen_nonblocking(int fd)
+{
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+  return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+/**
+ * @brief Connects to the jobserver named in MAKEFLAGS.
+ *
+ * @return int 1 if there is one and it could be used.
+ */
+static int
+join(char* makeflags)
+{
+  char* auth = strstr(makeflags, "--jobserver-auth=");
+  int r, w;
+
+  if (auth != NULL)
+    auth += strlen("--jobserver-auth=");
+  else if ((auth = strstr(makeflags, "--jobserver-fds=")) != NULL)
+    auth += strlen("--jobserver-fds=");
+  else
+    return 0;
+
+  if (strncmp(auth, "fifo:", 5) == 0) {
+    char* path = strndup(auth + 5, strcspn(auth + 5, " "));
+    read_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    write_fd = open(path, O_WRONLY | O_CLOEXEC);
+    free(path);
+  } else if (sscanf(auth, "%d,%d", &r, &w) == 2 && fcntl(r, F_GETFD) != -1 &&
+             fcntl(w, F_GETFD) != -1) {
+    read_fd = reopen_nonblocking(r);
+    write_fd = w;
+  }
+  if (read_fd == -1 || write_fd == -1) {
+    warn("Can't use the jobserver in MAKEFLAGS");
+    if (read_fd != -1)
+      close(read_fd);
+    read_fd = write_fd = -1;
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Makes a pipe holding count tokens and exports it in MAKEFLAGS.
+ */
+static void
+serve(int count)
+{
+  int fds[2];
+  char* old = getenv("MAKEFLAGS");
+  char* flags;
+
+  if (pipe(fds) == -1)
+    return;
+  for (int i = 0; i < count; i++) {
+    if (write(fds[1], "+", 1) != 1) {
+      close(fds[0]);
+      close(fds[1]);
+      return;
+    }
+  }
+  if ((read_fd = reopen_nonblocking(fds[0])) == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+  write_fd = fds[1];
+  if (asprintf(&flags, "-j%d --jobserver-fds=%d,%d --jobserver-auth=%d,%d%s%s",
+               count + 1, fds[0], fds[1], fds[0], fds[1],
+               old != NULL && *old != '\0' ? " " : "",
+               old != NULL ? old : "") != -1) {
+    setenv("MAKEFLAGS", flags, 1);
+    free(flags);
+  }
+}
+
+static void
+release_all()
+{
+  jobserver_release(0);
+}
+
+void
+jobserver_setup(int explicit_cooks)
+{
+  char* makeflags = getenv("MAKEFLAGS");
+  if (makeflags != NULL && join(makeflags)) {
+    debug("Joined jobserver %d,%d", read_fd, write_fd);
+    if (!explicit_cooks) {
+      MAX_COOKS = INT_MAX;
+      concurrency_start();
+    }
+  } else if (MAX_COOKS > 1) {
+    serve(MAX_COOKS - 1);
+  }
+  if (read_fd != -1)
+    atexit(release_all);
+}
+
+int
+jobserver_acquire(int wanted)
+{
+  char token;
+  if (read_fd == -1 || held >= wanted)
+    return 1;
+  // Don't keep reading an empty pipe: wait until it becomes readable.
+  if (starved)
+    return 0;
+  while (held < wanted) {
+    ssize_t n = read(read_fd, &token, 1);
+    if (n == 1) {
+      if (held == max_held) {
+        max_held = max_held ? 2 * max_held : 64;
+        tokens = realloc(tokens, max_held);
+      }
+      tokens[held++] = token;
+    } else if (n == -1 && errno == EINTR) {
+      continue;
+    } else {
+      starved = 1;
+      return 0;
+    }
+  }
+  starved = 0;
+  return 1;
+}
+
+void
+jobserver_release(int keep)
+{
+  while (held > keep) {
+    if (write(write_fd, &tokens[held - 1], 1) == -1 && errno == EINTR)
+      continue;
+    held--;
+    starved = 0;
+  }
+}
+
+void
+jobserver_refilled()
+{
+  starved = 0;
+}
+
+int
+jobserver_starved_fd()
+{
+  return starved ? read_fd : -1;
+}
@@ -1,26 +1,86 @@
 #include <errno.h>
+#include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cache.h"
+#include "command.h"
+#include "concurrency.h"
 #include "cookbook.h"
+#include "jobserver.h"
 #include "pipeline.h"
 #include "recipe.h"
+#include "stats.h"
 #include "workqueue.h"
 
 int
 main(int argc, char* argv[])
 {
-  int opt;
+  static struct option long_options[] = {
+    { "retries", required_argument, NULL, 'r' },
+    { "timeout", required_argument, NULL, 't' },
+    { "pipe-size", required_argument, NULL, 'p' },
+    { NULL, 0, NULL, 0 },
+  };
+  int opt, explicit_cooks = 0, retries = 0;
+  long long timeout_us = 0, pipe_size = 0;
+  double load;
+  char* end;
   char* path = "./rsrc/cookbook.ckb";
   MAX_COOKS = 1;
-  while ((opt = getopt(argc, argv, ":f:c:")) != -1) {
+  while ((opt = getopt_long(argc, argv, ":f:c:l:m:kC", long_options, NULL)) !=
+         -1) {
     switch (opt) {
       case 'f':
         path = optarg;
         break;
       case 'c':
-        MAX_COOKS = atoi(optarg);
+        explicit_cooks = 1;
+        if (strcmp(optarg, "auto") == 0)
+          concurrency_auto();
+        else
+          MAX_COOKS = atoi(optarg);
+        break;
+      case 'l':
+        load = strtod(optarg, &end);
+        if (end == optarg || *end != '\0' || !(load >= 0)) {
+          fprintf(stderr, "Bad load '%s'\n", optarg);
+          exit(1);
+        }
+        concurrency_max_load(load);
+        break;
+      case 'm':
+        if (parse_size(optarg) == -1) {
+          fprintf(stderr, "Bad memory budget '%s'\n", optarg);
+          exit(1);
+        }
+        concurrency_memory_budget(parse_size(optarg));
+        break;
+      case 'r':
+        if ((retries = atoi(optarg)) < 0) {
+          fprintf(stderr, "Bad number of retries '%s'\n", optarg);
+          exit(1);
+        }
+        break;
+      case 't':
+        if ((timeout_us = parse_duration(optarg)) == -1) {
+          fprintf(stderr, "Bad timeout '%s'\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'p':
+        if ((pipe_size = parse_size(optarg)) == -1 || pipe_size > INT_MAX) {
+          fprintf(stderr, "Bad pipe size '%s'\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'k':
+        keep_going_enable();
+        break;
+      case 'C':
+        cache_enable();
         break;
       case ':':
         debug("Option needs value");
@@ -30,6 +90,8 @@ main(int argc, char* argv[])
         break;
     }
   }
+  concurrency_start();
+  jobserver_setup(explicit_cooks);
   debug("Path %s", path);
   debug("Cooks %d", MAX_COOKS);
   COOKBOOK* cbp;
@@ -45,7 +107,7 @@ main(int argc, char* argv[])
   char *custom_main_recipe = argv[optind];
   debug("custom main rec %s", custom_main_recipe);
   if (custom_main_recipe != NULL) {
-    set_main_recipe(custom_main_recipe);
+    set_main_recipe(cbp, custom_main_recipe);
     debug("Main recipe provided %s", main_recipe->name);
   }
   if (err) {
@@ -54,8 +116,19 @@ main(int argc, char* argv[])
     exit(1);
   }
 
-  get_all_leaves(main_recipe->this_depends_on);
-  process_queue();
+  stats_load();
+  get_all_leaves(cbp, main_recipe);
+  read_recipe_hints();
+  read_retry_counts(retries);
+  read_timeouts(timeout_us);
+  read_pipe_sizes(pipe_size);
+  if (resolve_commands()) {
+    fprintf(stderr, "Error in cookbook '%s'\n", path);
+    exit(1);
+  }
+  int failures = process_queue();
+  stats_save();
 
-  exit(EXIT_SUCCESS);
+  free_cookbook(cbp);
+  exit(failures ? EXIT_FAILURE : EXIT_SUCCESS);
 }
@@ -0,0 +1,49 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/**
+ * @brief Work shared by the threads of parallel_for().
+ *
+ */
+typedef struct
+{
+  void (*body)(int i, void* arg);
+  void* arg;
+  int count;
+  atomic_int next;
+} PARALLEL_JOB;
+
+static void*
+worker(void* arg)
+{
+  PARALLEL_JOB* job = arg;
+  int i;
+  while ((i = atomic_fetch_add(&job->next, 1)) < job->count)
+    job->body(i, job->arg);
+  return NULL;
+}
+
+void
+parallel_for(int count, void (*body)(int i, void* arg), void* arg)
+{
+  PARALLEL_JOB job = { body, arg, count };
+  atomic_init(&job.next, 0);
+
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > MAX_PARALLEL_THREADS)
+    nthreads = MAX_PARALLEL_THREADS;
+  if (nthreads > count)
+    nthreads = count;
+  pthread_t threads[MAX_PARALLEL_THREADS];
+  int started = 0;
+  for (; started < nthreads - 1; started++) {
+    if (pthread_create(&threads[started], NULL, worker, &job) != 0)
+      break;
+  }
+  worker(&job);
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+}
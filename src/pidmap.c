@@ -0,0 +1,105 @@
+#include "pidmap.h"
+#include "hashtable.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PIDMAP_MIN_CAPACITY 64
+
+static PID_ENTRY* slots;
+static int capacity; // Always a power of two.
+static int count;
+
+static uint64_t
+pid_hash(pid_t pid)
+{
+  // Fibonacci hashing spreads consecutive pids over the table.
+  return (uint32_t)pid * 2654435769u;
+}
+
+static int
+home_slot(pid_t pid)
+{
+  return (int)(pid_hash(pid) & (capacity - 1));
+}
+
+static int
+holds(const void* slot, const void* pid)
+{
+  pid_t held = ((const PID_ENTRY*)slot)->pid;
+  return held == 0 || held == *(const pid_t*)pid;
+}
+
+static int
+find_slot(pid_t pid)
+{
+  return (int)hashtable_probe(slots, sizeof(PID_ENTRY), capacity,
+                              pid_hash(pid), holds, &pid);
+}
+
+static void
+place(PID_ENTRY entry)
+{
+  int i = find_slot(entry.pid);
+  if (slots[i].pid == 0)
+    count++;
+  slots[i] = entry;
+}
+
+static void
+grow()
+{
+  PID_ENTRY* old = slots;
+  int old_capacity = capacity;
+
+  capacity = capacity ? capacity * 2 : PIDMAP_MIN_CAPACITY;
+  slots = calloc(capacity, sizeof(PID_ENTRY));
+  count = 0;
+  for (int i = 0; i < old_capacity; i++) {
+    if (old[i].pid != 0)
+      place(old[i]);
+  }
+  free(old);
+}
+
+void
+pidmap_insert(pid_t pid, int id)
+{
+  if (hashtable_capacity(count + 1, PIDMAP_MIN_CAPACITY) > (size_t)capacity)
+    grow();
+  place((PID_ENTRY){ pid, id });
+}
+
+int
+pidmap_find(pid_t pid)
+{
+  if (capacity == 0)
+    return -1;
+  int i = find_slot(pid);
+  return slots[i].pid == pid ? slots[i].id : -1;
+}
+
+void
+pidmap_remove(pid_t pid)
+{
+  if (capacity == 0)
+    return;
+  int i = find_slot(pid);
+  if (slots[i].pid == 0)
+    return;
+
+  // Shift later entries of the probe run back into the hole, so lookups
+  // never need tombstones.
+  int hole = i;
+  for (int j = (i + 1) & (capacity - 1); slots[j].pid != 0;
+       j = (j + 1) & (capacity - 1)) {
+    int home = home_slot(slots[j].pid);
+    if (((j - home) & (capacity - 1)) >= ((j - hole) & (capacity - 1))) {
+      slots[hole] = slots[j];
+      hole = j;
+    }
+  }
+  slots[hole].pid = 0;
+  slots[hole].id = -1;
+  count--;
+}
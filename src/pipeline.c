@@ -1,178 +1,692 @@
 #include "pipeline.h"
+#include "builtin.h"
+#include "command.h"
+#include "concurrency.h"
+#include "jobserver.h"
+#include "stats.h"
+#include "timer.h"
+
+#include <limits.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <time.h>
+
+#define MAX_EVENTS 16
+
+extern char** environ;
 
-RECIPE* rec_link;
-RECIPE_LINK* link_to_add;
 volatile sig_atomic_t flag;
 
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static int jobserver_fd = -1; // Jobserver pipe while it is being watched.
+static sigset_t child_mask; // Signal mask to run steps with.
+static int keep_going;       // Set by -k: a failure only stops its dependents.
+static int retries_waiting;  // Failed recipes waiting for a retry timer.
+static int recipes_left;     // Recipes not finished yet.
+static long long work_left;  // Sum of their estimates, in microseconds.
+static int* arrivals;        // Recipes taken off the queue to be checked.
+
+static long long
+now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Marks a recipe finished, releases the recipes waiting on it and,
+ * when standard error is a terminal, reports how much work is expected to
+ * be left.
+ */
+static void
+finish_recipe(int id)
+{
+  static int progress = -1;
+  if (progress == -1)
+    progress = isatty(STDERR_FILENO);
+
+  graph.states[id].status = finished;
+  recipes_left--;
+  work_left -= graph.states[id].estimate;
+  if (progress && recipes_left > 0)
+    fprintf(stderr, "%s done, %d recipe%s left, about %.1fs to go\n",
+            graph.recipes[id]->name, recipes_left, recipes_left == 1 ? "" : "s",
+            work_left / 1e6 / (MAX_COOKS > 0 ? MAX_COOKS : 1));
+  release_dependents(id);
+}
+
+/**
+ * @brief Sets up the event loop: SIGCHLD is blocked and delivered through a
+ * signalfd watched by epoll instead of interrupting the scheduler. The
+ * signal mask from before is kept in child_mask.
+ */
+static void
+open_event_loop()
+{
+  sigset_t sigchld_mask;
+  struct epoll_event event = { .events = EPOLLIN };
+
+  sigemptyset(&sigchld_mask);
+  sigaddset(&sigchld_mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &sigchld_mask, &child_mask);
+
+  if ((signal_fd = signalfd(-1, &sigchld_mask, SFD_NONBLOCK | SFD_CLOEXEC)) ==
+        -1 ||
+      (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    error("Can't set up the event loop.");
+    exit(EXIT_FAILURE);
+  }
+  event.data.fd = signal_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+}
+
+/**
+ * @brief Watches the jobserver for returned tokens only while recipes are
+ * waiting for one; the pipe is readable whenever it holds tokens, so
+ * watching it otherwise would keep waking the loop up.
+ */
+static void
+watch_jobserver()
+{
+  struct epoll_event event = { .events = EPOLLIN };
+  int fd = jobserver_starved_fd();
+  if (fd == jobserver_fd)
+    return;
+  if (jobserver_fd != -1)
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, jobserver_fd, NULL);
+  event.data.fd = fd;
+  if (fd != -1)
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+  jobserver_fd = fd;
+}
+
+static void
+close_event_loop()
+{
+  close(epoll_fd);
+  close(signal_fd);
+  epoll_fd = signal_fd = jobserver_fd = -1;
+  sigprocmask(SIG_SETMASK, &child_mask, NULL);
+}
+
 void
-completed_recipe_handler(int signo)
+keep_going_enable()
 {
-  int status;
+  keep_going = 1;
+}
+
+void
+read_retry_counts(int retries)
+{
+  for (int i = 0; i < graph.count; i++) {
+    RECIPE* recipe = graph.recipes[i];
+    char* value = recipe_attribute(recipe, "retries");
+
+    graph.states[i].retries = retries;
+    if (value != NULL && (graph.states[i].retries = atoi(value)) < 0) {
+      fprintf(stderr, "Recipe %s: bad @retries=%s\n", recipe->name, value);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+long long
+parse_duration(char* text)
+{
+  char* end;
+  double value, unit = 1e6;
+
+  errno = 0;
+  value = strtod(text, &end);
+  if (end == text || errno != 0 || !(value >= 0))
+    return -1;
+  if (strcmp(end, "ms") == 0)
+    unit = 1e3;
+  else if (strcmp(end, "m") == 0)
+    unit = 60e6;
+  else if (strcmp(end, "h") == 0)
+    unit = 3600e6;
+  else if (*end != '\0' && strcmp(end, "s") != 0)
+    return -1;
+  return value * unit > 1e18 ? -1 : (long long)(value * unit);
+}
+
+void
+read_timeouts(long long timeout_us)
+{
+  for (int i = 0; i < graph.count; i++) {
+    RECIPE* recipe = graph.recipes[i];
+    char* value = recipe_attribute(recipe, "timeout");
+
+    graph.states[i].timeout_us = timeout_us;
+    if (value != NULL &&
+        (graph.states[i].timeout_us = parse_duration(value)) == -1) {
+      fprintf(stderr, "Recipe %s: bad @timeout=%s\n", recipe->name, value);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/**
+ * @brief Records that a step of the current task of a recipe failed, where
+ * step is its position in the pipeline (-1 if the task's redirections or
+ * pipes couldn't be set up) and status its wait status (-1 if it couldn't
+ * be started). As with pipefail in bash, the rightmost failed step is the
+ * one the task's failure is blamed on.
+ */
+static void
+step_failed(int id, int step, int status)
+{
+  STATE* state = &graph.states[id];
+  if (!state->task_failed || step > state->failed_step) {
+    state->failed_step = step;
+    state->exit_status = status;
+  }
+  state->task_failed = 1;
+}
+
+/**
+ * @brief Tells why a recipe failed, naming the step that is blamed for it.
+ */
+static void
+print_failure(int id)
+{
+  STATE* state = &graph.states[id];
+  char* name = graph.recipes[id]->name;
+  STEP* step = state->task->steps;
+  int status = state->exit_status;
+
+  if (state->timed_out) {
+    fprintf(stderr, "Recipe %s timed out after %.1fs\n", name,
+            state->timeout_us / 1e6);
+    return;
+  }
+  if (state->failed_step == -1) {
+    fprintf(stderr, "Recipe %s failed: can't set up its redirections\n", name);
+    return;
+  }
+  for (int i = 0; i < state->failed_step; i++)
+    step = step->next;
+  if (status == -1)
+    fprintf(stderr, "Recipe %s failed: can't start %s\n", name,
+            step->words[0]);
+  else if (WIFSIGNALED(status))
+    fprintf(stderr, "Recipe %s failed: %s was killed by signal %d (%s)\n",
+            name, step->words[0], WTERMSIG(status),
+            strsignal(WTERMSIG(status)));
+  else
+    fprintf(stderr, "Recipe %s failed: %s exited with status %d\n", name,
+            step->words[0], WEXITSTATUS(status));
+}
+
+void
+read_pipe_sizes(int pipe_size)
+{
+  for (int i = 0; i < graph.count; i++) {
+    RECIPE* recipe = graph.recipes[i];
+    char* value = recipe_attribute(recipe, "pipe_size");
+    long long size;
+
+    graph.states[i].pipe_size = pipe_size;
+    if (value == NULL)
+      continue;
+    if ((size = parse_size(value)) == -1 || size > INT_MAX) {
+      fprintf(stderr, "Recipe %s: bad @pipe_size=%s\n", recipe->name, value);
+      exit(EXIT_FAILURE);
+    }
+    graph.states[i].pipe_size = size;
+  }
+}
+
+/**
+ * @brief Gives up on a recipe. Without -k the whole cookbook is given up:
+ * every step still running is waited for and cook exits with an error.
+ * With -k only the recipes depending on it are skipped.
+ */
+static void
+fail_recipe(int id)
+{
+  print_failure(id);
+  graph.states[id].status = failed;
+  if (!keep_going) {
+    while (wait(NULL) > 0)
+      ;
+    exit(EXIT_FAILURE);
+  }
+  recipes_left -= 1 + poison_dependents(id);
+  work_left -= graph.states[id].estimate;
+}
+
+/**
+ * @brief Called once every step of a failed task is gone. The recipe's
+ * cooks are given back, and it is either given up on or, while it has
+ * retries left, set to be queued again after a delay that doubles with
+ * every attempt. Other recipes keep being cooked in the meantime.
+ */
+static void
+retry_or_fail_recipe(int id)
+{
+  STATE* state = &graph.states[id];
+  concurrency_finished(id);
+  if (state->attempts >= state->retries) {
+    fail_recipe(id);
+    return;
+  }
+  long long delay_ms = (long long)RETRY_DELAY_MS
+                       << (state->attempts < 20 ? state->attempts : 20);
+  if (delay_ms > RETRY_MAX_DELAY_MS)
+    delay_ms = RETRY_MAX_DELAY_MS;
+  state->attempts++;
+  print_failure(id);
+  fprintf(stderr, "Retrying %s (%d of %d) in %.1fs\n", graph.recipes[id]->name,
+          state->attempts, state->retries, delay_ms / 1e3);
+  state->status = retrying;
+  state->task_failed = state->timed_out = 0;
+  state->cpu_us = state->max_rss_kb = 0;
+  retries_waiting++;
+  timer_add(now_us() + delay_ms * 1000, id, TIMER_RETRY);
+}
+
+/**
+ * @brief Kills every process of the task a recipe is stuck in, all at once
+ * through its process group, and fails the task without waiting for them:
+ * they are forgotten, so their cooks are free right away, and their exit
+ * is reaped but ignored.
+ */
+static void
+time_out_recipe(int id)
+{
+  STATE* state = &graph.states[id];
+  int steps = count_number_of_steps(state->task->steps);
+
+  info("Recipe %s timed out after %.1fs", graph.recipes[id]->name,
+       state->timeout_us / 1e6);
+  state->timed_out = 1;
+  if (state->pgid > 0)
+    kill(-state->pgid, SIGKILL);
+  for (int i = 0; i < steps; i++) {
+    if (state->pids[i] != 0)
+      pidmap_remove(state->pids[i]);
+    state->pids[i] = 0;
+  }
+  state->running_steps = 0;
+  retry_or_fail_recipe(id);
+}
+
+/**
+ * @brief Acts on the timers that have expired: recipes whose retry delay is
+ * over are queued again, and recipes still cooking past their deadline are
+ * timed out. The timeouts of recipes that are done by then are ignored.
+ */
+static void
+handle_timers()
+{
+  TIMER timer;
+  if (timer_is_empty())
+    return;
+  for (long long now = now_us(); timer_expired(now, &timer);) {
+    STATE* state = &graph.states[timer.id];
+    if (timer.kind == TIMER_RETRY) {
+      retries_waiting--;
+      state->queued = 0;
+      q_enqueue(timer.id);
+    } else if (state->status == started && state->deadline_us == timer.due_us) {
+      time_out_recipe(timer.id);
+    }
+  }
+}
+
+/**
+ * @brief Prints which recipes failed and which were skipped because of
+ * them, as in "Failed: a b" and "Skipped: c".
+ *
+ * @return int The number of recipes that failed.
+ */
+static int
+report_failures()
+{
+  static const char* labels[] = { "Failed:", "Skipped:" };
+  STATUS statuses[] = { failed, skipped };
+  int count = 0;
+
+  for (int i = 0; i < graph.count; i++)
+    count += graph.states[i].status == failed;
+  if (count == 0)
+    return 0;
+  for (int k = 0; k < 2; k++) {
+    int printed = 0;
+    for (int i = 0; i < graph.count; i++) {
+      if (graph.states[i].status != statuses[k])
+        continue;
+      fprintf(stderr, "%s %s", printed++ ? "" : labels[k],
+              graph.recipes[i]->name);
+    }
+    if (printed)
+      fputc('\n', stderr);
+  }
+  return count;
+}
+
+/**
+ * @brief Starts the current task of a recipe that is being cooked, or
+ * finishes the recipe once it has no tasks left. Tasks that are run by a
+ * builtin are done at once, so the recipe goes straight on to the next one.
+ */
+static void
+continue_recipe(int id)
+{
+  STATE* state = &graph.states[id];
+  for (;;) {
+    if (state->task == NULL) {
+      cache_store(id);
+      debug("Recipe %s success!", graph.recipes[id]->name);
+      stats_record(id, now_us() - state->start_us, state->cpu_us,
+                   state->max_rss_kb);
+      concurrency_finished(id);
+      finish_recipe(id);
+      return;
+    }
+    if (start_task(id)) {
+      // Steps that did start are waited for before the task counts as
+      // failed.
+      if (state->running_steps == 0)
+        retry_or_fail_recipe(id);
+      return;
+    }
+    if (state->running_steps > 0)
+      return;
+    state->task = state->task->next;
+  }
+}
+
+void
+reap_completed_steps()
+{
+  int id;
   pid_t child_pid;
+  int status;
+  struct rusage usage;
 
-  while ((child_pid = waitpid(-1, &status, WNOHANG)) != 0) {
-    if (child_pid == -1) {
-      break;
+  while ((child_pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+    if ((id = pidmap_find(child_pid)) == -1)
+      continue;
+    pidmap_remove(child_pid);
+    STATE* state = &graph.states[id];
+    int step = 0;
+    while (state->pids[step] != child_pid)
+      step++;
+    state->pids[step] = 0;
+    state->cpu_us += usage.ru_utime.tv_sec * 1000000L + usage.ru_utime.tv_usec +
+                     usage.ru_stime.tv_sec * 1000000L + usage.ru_stime.tv_usec;
+    if (usage.ru_maxrss > state->max_rss_kb)
+      state->max_rss_kb = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      step_failed(id, step, status);
+    if (--state->running_steps > 0)
+      continue;
+    if (state->task_failed) {
+      retry_or_fail_recipe(id);
+    } else {
+      state->task = state->task->next;
+      continue_recipe(id);
     }
-    ACTIVE_COOKS--;
-    rec_link = find_by_pid(child_pid);
-    link_to_add->recipe = rec_link;
-    if (WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_FAILURE)) {
-      error("Recipe failed!");
-      ((STATE*)rec_link->state)->status = failed;
-      while (wait(NULL) > 0)
+  }
+}
+
+/**
+ * @brief Sleeps until at least one event arrives (or timeout milliseconds
+ * pass, unless timeout is -1), then handles all of the pending ones.
+ * SIGCHLD notifications are coalesced, so the signalfd is drained and
+ * every exited child is reaped in one batch.
+ */
+static void
+wait_for_events(int timeout)
+{
+  struct epoll_event events[MAX_EVENTS];
+  struct signalfd_siginfo info[MAX_EVENTS];
+  int n;
+
+  while ((n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout)) == -1) {
+    if (errno != EINTR) {
+      error("Waiting for events failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.fd == signal_fd) {
+      while (read(signal_fd, info, sizeof(info)) > 0)
         ;
-      _exit(EXIT_FAILURE);
+      reap_completed_steps();
+    } else if (events[i].data.fd == jobserver_fd) {
+      concurrency_tokens_returned();
+    }
+  }
+}
+
+/**
+ * @brief Checks the recipes queued since the last call before they compete
+ * for cooks: those that are up to date or restored from the cache are
+ * finished at once, so they never take a cook or a jobserver token, and the
+ * others are put in the heap. A failed attempt may have left its targets
+ * behind, so a recipe being retried is always cooked.
+ *
+ * @return int Number of recipes finished.
+ */
+static int
+finish_arrivals()
+{
+  int count = q_take_arrivals(arrivals), finished = 0;
+  // The recipes in a batch don't depend on each other: one that depends on a
+  // recipe finished below arrives in the next batch.
+  cache_compute_keys(arrivals, count);
+  for (int i = 0; i < count; i++) {
+    int id = arrivals[i];
+    if (graph.states[id].attempts == 0 &&
+        (is_recipe_up_to_date(id) || cache_restore(id))) {
+      debug("Recipe %s is up to date", graph.recipes[id]->name);
+      finish_recipe(id);
+      finished++;
     } else {
-      debug("Recipe %s success!", rec_link->name);
-      ((STATE*)rec_link->state)->status = finished;
-      queue_recipes_from_depend_on_this_list(link_to_add);
+      q_insert(id);
     }
   }
+  return finished;
 }
 
-void
+int
 process_queue()
 {
-  link_to_add = malloc(sizeof(RECIPE_LINK));
-  pid_t pid;
   ACTIVE_COOKS = 0;
-  sigset_t sigchild_blocked_mask, inverse_sigchild_blocked_mask;
-  TASK* recipe_tasks;
-
-  sigemptyset(&sigchild_blocked_mask);
-  sigaddset(&sigchild_blocked_mask, SIGCHLD);
-
-  sigfillset(&inverse_sigchild_blocked_mask);
-  sigdelset(&inverse_sigchild_blocked_mask, SIGCHLD);
-
-  struct sigaction act;
-  act.sa_handler = &completed_recipe_handler;
-  act.sa_flags = SA_RESTART;
-  sigemptyset(&act.sa_mask);
-  sigaddset(&act.sa_mask, SIGCHLD);
-  sigaction(SIGCHLD, &act, NULL);
-
-  sigprocmask(SIG_BLOCK, &sigchild_blocked_mask, NULL);
-  while ((q != NULL || ACTIVE_COOKS > 0)) {
-    if ((ACTIVE_COOKS == MAX_COOKS) || q == NULL) {
-      sigsuspend(&inverse_sigchild_blocked_mask);
-    } else {
-      if ((pid = fork()) == -1) {
-        error("Error forking child.");
-        _exit(1);
-      } else if (pid == 0) {
-        // CHILD PROCESS
-        recipe_tasks = q->recipe->recipe->tasks;
-        while (recipe_tasks != NULL) {
-          if (process_steps(recipe_tasks))
-            _exit(EXIT_FAILURE);
-          recipe_tasks = recipe_tasks->next;
-        }
-        _exit(EXIT_SUCCESS);
-      }
-      ACTIVE_COOKS++;
-      // PARENT PROCESS
-      ((STATE*)q->recipe->recipe->state)->status = started;
-      ((STATE*)q->recipe->recipe->state)->worker_pid = pid;
-      QUEUE *free_this = q;
-      q = q->next;
-      free(free_this);
+  int id;
+
+  recipes_left = graph.count;
+  work_left = 0;
+  for (int i = 0; i < graph.count; i++)
+    work_left += graph.states[i].estimate;
+  arrivals = malloc(graph.count * sizeof(int));
+  open_event_loop();
+  while (!q_is_empty() || ACTIVE_COOKS > 0 || retries_waiting > 0) {
+    handle_timers();
+    if (finish_arrivals() > 0)
+      continue;
+    adjust_concurrency();
+    // Take the most urgent recipe that fits in the free cooks and memory;
+    // if the most urgent one doesn't, smaller ones may still fill the gap.
+    if (q_is_empty() || ACTIVE_COOKS >= MAX_COOKS ||
+        (id = q_dequeue_if(concurrency_admit, concurrency_room_changed())) ==
+          -1) {
+      // Wake up for the next timer and, while recipes are held back by an
+      // adaptive limit, to sample the system again even if no step exits.
+      int timeout = timer_wait_ms(now_us());
+      if (!q_is_empty() && concurrency_adaptive() &&
+          (timeout == -1 || timeout > CONCURRENCY_INTERVAL_MS))
+        timeout = CONCURRENCY_INTERVAL_MS;
+      watch_jobserver();
+      wait_for_events(timeout);
+      continue;
+    }
+    concurrency_started(id);
+    graph.states[id].status = started;
+    graph.states[id].start_us = now_us();
+    graph.states[id].task = graph.recipes[id]->tasks;
+    if (graph.states[id].timeout_us > 0) {
+      graph.states[id].deadline_us =
+        graph.states[id].start_us + graph.states[id].timeout_us;
+      timer_add(graph.states[id].deadline_us, id, TIMER_TIMEOUT);
     }
+    continue_recipe(id);
+  }
+  close_event_loop();
+  free(arrivals);
+  return report_failures();
+}
+
+/**
+ * @brief Starts the process for one step of a pipeline with posix_spawn(),
+ * with its standard input and output connected to in and out (-1 keeps the
+ * scheduler's). The program is looked up with resolve_command(), so only
+ * one execve() is ever attempted.
+ *
+ * Unless pgid is NULL the step is put in the process group *pgid, or in a
+ * new one led by the step if *pgid is 0, in which case *pgid is set to it.
+ *
+ * @return pid_t The pid of the step, or -1 if it couldn't be started.
+ */
+static pid_t
+spawn_step(STEP* step, int in, int out, pid_t* pgid)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  pid_t pid;
+  char* command = resolve_command(step->words[0]);
+
+  if (command == NULL) {
+    error("Error executing %s", step->words[0]);
+    return -1;
+  }
+  posix_spawn_file_actions_init(&actions);
+  if (in != -1)
+    posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+  if (out != -1)
+    posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &child_mask);
+  if (pgid != NULL) {
+    posix_spawnattr_setpgroup(&attr, *pgid);
+    posix_spawnattr_setflags(&attr,
+                             POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+  } else {
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+  }
+
+  int err = posix_spawn(&pid, command, &actions, &attr, step->words, environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  if (err != 0) {
+    error("Error executing %s: %s", command, strerror(err));
+    return -1;
   }
-  free(link_to_add);
+  if (pgid != NULL && *pgid == 0)
+    *pgid = pid;
+  return pid;
 }
 
 int
-process_steps(TASK* task)
+start_task(int id)
 {
-  STEP* main_step = task->steps;
+  STATE* state = &graph.states[id];
+  TASK* task = state->task;
   /*
    * fd[0] - used to read from pipe
    * fd[1] - used to write to pipe
    */
   int in = -1, out = -1;
-  int NUMBER_OF_STEPS = count_number_of_steps(main_step);
-  int LAST_CHILD_PROCESS = NUMBER_OF_STEPS - 1;
-  int pipefd[NUMBER_OF_STEPS - 1][2];
-  pid_t pid;
-  char* util_directory = malloc(8);
-  strcpy(util_directory, "./util/");
+  int NUMBER_OF_STEPS = count_number_of_steps(task->steps);
+  STEP* steps[NUMBER_OF_STEPS];
+  int positions[NUMBER_OF_STEPS];
 
-  if (initialize_pipes(pipefd, NUMBER_OF_STEPS)) {
-    free(util_directory);
-    return 1;
+  // Plain "cat" stages only pass data along, so they are left out and their
+  // neighbours are connected directly: "cat < file | a" becomes "a < file",
+  // "a | cat > file" becomes "a > file" and "a | cat | b" becomes "a | b".
+  // A cat reading or writing cook's own standard input or output is kept,
+  // as the step next to it may behave differently on a terminal. A pipeline
+  // of nothing but cat keeps one of them.
+  int position = 0;
+  NUMBER_OF_STEPS = 0;
+  for (STEP* step = task->steps; step != NULL; step = step->next) {
+    state->pids[position] = 0;
+    int elide;
+    if (position == 0)
+      elide = step->next != NULL && task->input_file != NULL;
+    else
+      elide = step->next != NULL || task->output_file != NULL;
+    elide = elide && is_pass_through(step);
+    if (!elide || (step->next == NULL && NUMBER_OF_STEPS == 0)) {
+      steps[NUMBER_OF_STEPS] = step;
+      positions[NUMBER_OF_STEPS++] = position;
+    }
+    position++;
   }
+  int LAST_CHILD_PROCESS = NUMBER_OF_STEPS - 1;
+  int pipefd[NUMBER_OF_STEPS][2];
 
   if ((in = open_for_reading(task->input_file)) == -1) {
-    free(util_directory);
+    step_failed(id, -1, -1);
     return 1;
   }
-  else if (in == 0)
-    in = -1;
-
   if ((out = open_for_writing(task->output_file)) == -1) {
-    free(util_directory);
+    if (in > 0)
+      close(in);
+    step_failed(id, -1, -1);
     return 1;
   }
-  else if (out == 0)
+  if (in == 0)
+    in = -1;
+  if (out == 0)
     out = -1;
 
+  // A single step that cook can do itself is run right here.
+  int status;
+  if (NUMBER_OF_STEPS == 1 && (status = run_builtin(steps[0], out)) != -1) {
+    if (status != 0)
+      step_failed(id, positions[0], W_EXITCODE(status, 0));
+    NUMBER_OF_STEPS = 0;
+  } else if (initialize_pipes(pipefd, NUMBER_OF_STEPS, state->pipe_size)) {
+    step_failed(id, -1, -1);
+    NUMBER_OF_STEPS = 0;
+  }
+
+  // The pipes and redirections are close-on-exec, so each step only keeps
+  // the ends it was given as its standard input and output.
+  // A step that can't be started fails the task, but the others are still
+  // started as if it had exited at once: the steps next to it see the end
+  // of their pipes.
+  // With a timeout, the steps get a process group of their own, so that
+  // they can all be killed at once.
+  state->pgid = 0;
   for (int i = 0; i < NUMBER_OF_STEPS; i++) {
-    switch ((pid = fork())) {
-      case -1:
-        error("Forking failed!");
-        free(util_directory);
-        return 1;
-      case 0:               // Child Process
-        if (i == 0 && in) { // If first child and input file is provided
-          if (redirect_input(in)) {
-            free(util_directory);
-            return 1;
-          }
-        } else {
-          if (redirect_input(pipefd[i - 1][READ_END])) {
-            free(util_directory);
-            return 1;
-          }
-        }
-        if (i != LAST_CHILD_PROCESS && NUMBER_OF_STEPS > 1) {
-          if (redirect_output(pipefd[i][WRITE_END])) {
-            free(util_directory);
-            return 1;
-          }
-        } else if (i == LAST_CHILD_PROCESS && out) {
-          if (redirect_output(out)) {
-            free(util_directory);
-            return 0;
-          }
-        }
-        for (int j = 0; j < NUMBER_OF_STEPS - 1; j++) {
-          CLOSE_BOTH_ENDS(pipefd[j]);
-        }
-        execute_command(util_directory, main_step->words);
+    pid_t pid = spawn_step(steps[i],
+                           i == 0 ? in : pipefd[i - 1][READ_END],
+                           i == LAST_CHILD_PROCESS ? out : pipefd[i][WRITE_END],
+                           state->timeout_us > 0 ? &state->pgid : NULL);
+    if (pid != -1) {
+      state->pids[positions[i]] = pid;
+      pidmap_insert(pid, id);
+      state->running_steps++;
+    } else {
+      step_failed(id, positions[i], -1);
     }
-    main_step = main_step->next;
   }
-  for (int i = 0; i < NUMBER_OF_STEPS; i++) {
-    if (i < NUMBER_OF_STEPS - 1)
-      CLOSE_BOTH_ENDS(pipefd[i]);
-    wait(NULL);
+  for (int i = 0; i < NUMBER_OF_STEPS - 1; i++) {
+    CLOSE_BOTH_ENDS(pipefd[i]);
   }
-  free(util_directory);
-  close(in);
-  close(out);
-  return 0;
-}
-
-void
-execute_command(char* util_path, char** steps)
-{
-  char* command = strcat(util_path, *steps);
-  execvp(command, steps);
-  error("Error executing %s", command);
-  debug("Attempting to exectute %s on system path", *steps);
-  execvp(*steps, steps);
-  error("Error executing %s", *steps);
-  _exit(1);
+  if (in != -1)
+    close(in);
+  if (out != -1)
+    close(out);
+  return state->task_failed;
 }
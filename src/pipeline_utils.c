@@ -1,78 +1,85 @@
+#define _GNU_SOURCE
 #include "pipeline_utils.h"
 
 int
-redirect_input(int fd)
+open_for_reading(char* path)
 {
-  if (fd > -1) {
-    if (dup2(fd, STDIN_FILENO) == -1) {
-      error("Error duping!");
-      return 1;
-    }
-  }
-  return 0;
+  if (path == NULL)
+    return 0;
+  int in = open(path, O_RDONLY | O_CLOEXEC);
+  if (in < 0)
+    return -1;
+  return in;
 }
 
 int
-redirect_output(int fd)
+open_for_writing(char* path)
 {
-  if (fd > -1) {
-    if (dup2(fd, STDOUT_FILENO) == -1) {
-      error("Error duping");
-      return 1;
-    }
-  }
-  return 0;
+  if (path == NULL)
+    return 0;
+  int out = open(path, O_CREAT | O_RDWR | O_CLOEXEC, 0666);
+  if (out < 0)
+    return -1;
+  return out;
 }
 
 int
-write_dup(int output_file_fd, int file_descriptor)
+initialize_pipes(int pipefd[][2], int number_of_steps, int pipe_size)
 {
-  if (output_file_fd > -1) {
-    if (dup2(output_file_fd, STDOUT_FILENO) == -1) {
-      error("Error duping");
-      return 1;
-    }
-  } else {
-    if (dup2(file_descriptor, STDOUT_FILENO) == -1) {
-      error("Error duping");
+  for (int i = 0; i < number_of_steps - 1; i++) {
+    if (pipe2(pipefd[i], O_CLOEXEC) < 0) {
+      error("Error creating pipe!");
+      while (i-- > 0) {
+        close(pipefd[i][0]);
+        close(pipefd[i][1]);
+      }
       return 1;
     }
+    // Going over /proc/sys/fs/pipe-max-size fails with EPERM; the pipe is
+    // still usable at its default size.
+    if (pipe_size > 0 && fcntl(pipefd[i][1], F_SETPIPE_SZ, pipe_size) == -1)
+      debug("Can't resize pipe to %d bytes: %s", pipe_size, strerror(errno));
   }
   return 0;
 }
 
 int
-open_for_reading(char* path)
+write_all(int fd, const void* data, size_t size)
 {
-  int in = open(path, O_RDONLY);
-  if (path == NULL)
-    return 0;
-  else if (in < 0)
-    return -1;
-  else
-    return in;
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    data = (const char*)data + n;
+    size -= n;
+  }
+  return 0;
 }
 
 int
-open_for_writing(char* path)
+copy_contents(int in, int out)
 {
-  int out = open(path, O_CREAT | O_RDWR, 0666);
-  if (path == NULL)
-    return 0;
-  else if (out < 0)
-    return -1;
-  else
-    return out;
-}
+  char buf[65536];
+  ssize_t n;
 
-int
-initialize_pipes(int pipefd[][2], int number_of_steps)
-{
-  for (int i = 0; i < number_of_steps - 1; i++) {
-    if (pipe(pipefd[i]) < 0) {
-      error("Error creating pipe!");
-      return 1;
-    }
+  for (;;) {
+    n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+    if (n == -1 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                    errno == EOPNOTSUPP))
+      break;
+    if (n == -1 && errno != EINTR)
+      return -1;
+    if (n == 0)
+      return 0;
+  }
+  while ((n = read(in, buf, sizeof(buf))) != 0) {
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1 || write_all(out, buf, n) == -1)
+      return -1;
   }
   return 0;
 }
@@ -1,42 +1,236 @@
 #include "recipe.h"
 #include "debug.h"
+#include "hash.h"
+#include "parallel.h"
+#include "stats.h"
 #include "workqueue.h"
 
-void
-get_all_leaves(RECIPE_LINK* depend_list)
+#include <sys/stat.h>
+
+GRAPH graph;
+
+#define UNVISITED -1
+#define VISITING -2
+#define TASK_HASH_SEED 0x7461736bULL
+
+/**
+ * @brief A recipe on the depth-first search stack of get_all_leaves(),
+ * along with the next dependency of it that still has to be visited.
+ *
+ */
+typedef struct
 {
-  while (depend_list != NULL) {
-    if (depend_list->recipe->this_depends_on == NULL) {
-      q_enqueue(depend_list);
+  RECIPE* recipe;
+  RECIPE_LINK* next_dependency;
+} FRAME;
+
+/**
+ * @brief Fills in the edge arrays of graph from the recipe links, once
+ * every reachable recipe has its index.
+ */
+static void
+compile_edges(COOKBOOK* cbp, int edges)
+{
+  int n = graph.count;
+  graph.dependencies_start = cookbook_alloc(cbp, (n + 1) * sizeof(int));
+  graph.dependencies = cookbook_alloc(cbp, (edges + 1) * sizeof(int));
+  graph.dependents_start = cookbook_alloc(cbp, (n + 1) * sizeof(int));
+  graph.dependents = cookbook_alloc(cbp, (edges + 1) * sizeof(int));
+
+  int e = 0;
+  for (int i = 0; i < n; i++) {
+    graph.dependencies_start[i] = e;
+    for (RECIPE_LINK* link = graph.recipes[i]->this_depends_on; link != NULL;
+         link = link->next) {
+      int dep = *(int*)link->recipe->state;
+      graph.dependencies[e++] = dep;
+      graph.dependents_start[dep + 1]++;
     }
-    get_all_leaves(depend_list->recipe->this_depends_on);
-    depend_list = depend_list->next;
+    graph.states[i].pending = e - graph.dependencies_start[i];
   }
+  graph.dependencies_start[n] = e;
+
+  // Turn the dependent counts into offsets, then place each edge, using
+  // dependents_start[i] as the fill position of recipe i. That leaves it at
+  // the end of the range of recipe i, so the offsets are shifted back after.
+  for (int i = 0; i < n; i++)
+    graph.dependents_start[i + 1] += graph.dependents_start[i];
+  for (int i = 0; i < n; i++) {
+    for (int j = graph.dependencies_start[i];
+         j < graph.dependencies_start[i + 1];
+         j++) {
+      int dep = graph.dependencies[j];
+      graph.dependents[graph.dependents_start[dep]++] = i;
+    }
+  }
+  for (int i = n; i > 0; i--)
+    graph.dependents_start[i] = graph.dependents_start[i - 1];
+  graph.dependents_start[0] = 0;
 }
 
-int
-is_dependencies_completed(RECIPE_LINK* recipe)
+/**
+ * @brief Hashes the words of the steps of a recipe and the names of its
+ * redirection files into its task_hash.
+ */
+static void
+hash_tasks(int i, void* arg)
 {
-  RECIPE_LINK* dependencies = recipe->recipe->this_depends_on;
-  while (dependencies != NULL) {
-    STATE* state = dependencies->recipe->state;
-    if (state == NULL || state->status != finished)
-      return 0;
-    dependencies = dependencies->next;
+  HASH_STATE hs;
+  hash_init(&hs, TASK_HASH_SEED);
+  for (TASK* task = graph.recipes[i]->tasks; task != NULL; task = task->next) {
+    hash_update(&hs, "T", 1);
+    for (STEP* step = task->steps; step != NULL; step = step->next) {
+      hash_update(&hs, "S", 1);
+      for (char** word = step->words; *word != NULL; word++)
+        hash_string(&hs, *word);
+    }
+    if (task->input_file != NULL) {
+      hash_update(&hs, "<", 1);
+      hash_string(&hs, task->input_file);
+    }
+    if (task->output_file != NULL) {
+      hash_update(&hs, ">", 1);
+      hash_string(&hs, task->output_file);
+    }
+  }
+  graph.states[i].task_hash = hash_final(&hs);
+}
+
+/**
+ * @brief Sets the priority of every recipe in graph to its own estimated
+ * cost plus the highest priority of the recipes depending on it. Dependents
+ * have higher indices, so walking backwards sees them first.
+ */
+static void
+compute_priorities()
+{
+  for (int i = graph.count - 1; i >= 0; i--) {
+    long downstream = 0;
+    for (int j = graph.dependents_start[i]; j < graph.dependents_start[i + 1];
+         j++) {
+      long priority = graph.states[graph.dependents[j]].priority;
+      if (priority > downstream)
+        downstream = priority;
+    }
+    graph.states[i].estimate = stats_estimate(i);
+    graph.states[i].priority = graph.states[i].estimate + downstream;
+  }
+}
+
+void
+get_all_leaves(COOKBOOK* cbp, RECIPE* root)
+{
+  int max_frames = 64, frames = 0, max_order = 64, edges = 0, total = 0;
+  FRAME* stack = malloc(max_frames * sizeof(FRAME));
+  RECIPE** order = malloc(max_order * sizeof(RECIPE*));
+
+  for (RECIPE* recipe = cbp->recipes; recipe != NULL; recipe = recipe->next)
+    total++;
+  int* index = cookbook_alloc(cbp, total * sizeof(int));
+  total = 0;
+  for (RECIPE* recipe = cbp->recipes; recipe != NULL; recipe = recipe->next) {
+    index[total] = UNVISITED;
+    recipe->state = &index[total++];
+  }
+
+  graph.count = 0;
+  *(int*)root->state = VISITING;
+  stack[frames++] = (FRAME){ root, root->this_depends_on };
+
+  while (frames > 0) {
+    FRAME* top = &stack[frames - 1];
+    RECIPE_LINK* dependency = top->next_dependency;
+    if (dependency != NULL) {
+      top->next_dependency = dependency->next;
+      edges++;
+      int* mark = dependency->recipe->state;
+      if (*mark == UNVISITED) {
+        if (frames == max_frames) {
+          max_frames *= 2;
+          stack = realloc(stack, max_frames * sizeof(FRAME));
+        }
+        *mark = VISITING;
+        stack[frames++] =
+          (FRAME){ dependency->recipe, dependency->recipe->this_depends_on };
+      } else if (*mark == VISITING) {
+        error("Recipe %s depends on itself through %s!",
+              dependency->recipe->name, top->recipe->name);
+        exit(EXIT_FAILURE);
+      }
+      continue;
+    }
+
+    // All dependencies are done, so the recipe goes after them in the order.
+    RECIPE* recipe = top->recipe;
+    frames--;
+    if (graph.count == max_order) {
+      max_order *= 2;
+      order = realloc(order, max_order * sizeof(RECIPE*));
+    }
+    *(int*)recipe->state = graph.count;
+    order[graph.count++] = recipe;
+  }
+  free(stack);
+
+  graph.recipes = cookbook_alloc(cbp, graph.count * sizeof(RECIPE*));
+  memcpy(graph.recipes, order, graph.count * sizeof(RECIPE*));
+  free(order);
+  graph.states = cookbook_alloc(cbp, graph.count * sizeof(STATE));
+  // Room for the pids of the longest task of each recipe.
+  for (int i = 0; i < graph.count; i++) {
+    int steps = 1;
+    for (TASK* task = graph.recipes[i]->tasks; task != NULL;
+         task = task->next) {
+      int n = count_number_of_steps(task->steps);
+      if (n > steps)
+        steps = n;
+    }
+    graph.states[i].pids = cookbook_alloc(cbp, steps * sizeof(pid_t));
+  }
+  compile_edges(cbp, edges);
+  parallel_for(graph.count, hash_tasks, NULL);
+  compute_priorities();
+
+  q_init(graph.count);
+  for (int i = 0; i < graph.count; i++) {
+    if (graph.states[i].pending == 0)
+      q_enqueue(i);
   }
-  return 1;
 }
 
 void
-queue_recipes_from_depend_on_this_list(RECIPE_LINK* recipe)
+release_dependents(int id)
 {
-  RECIPE_LINK* dependencies = recipe->recipe->depend_on_this;
-  while (dependencies != NULL) {
-    if (is_dependencies_completed(dependencies)) {
-      q_enqueue(dependencies);
+  for (int j = graph.dependents_start[id]; j < graph.dependents_start[id + 1];
+       j++) {
+    int dependent = graph.dependents[j];
+    if (--graph.states[dependent].pending == 0)
+      q_enqueue(dependent);
+  }
+}
+
+int
+poison_dependents(int id)
+{
+  int* stack = malloc(graph.count * sizeof(int));
+  int top = 0, count = 0;
+
+  stack[top++] = id;
+  while (top > 0) {
+    int current = stack[--top];
+    for (int j = graph.dependents_start[current];
+         j < graph.dependents_start[current + 1];
+         j++) {
+      int dependent = graph.dependents[j];
+      if (graph.states[dependent].status != waiting)
+        continue;
+      graph.states[dependent].status = skipped;
+      stack[top++] = dependent;
+      count++;
     }
-    dependencies = dependencies->next;
   }
+  free(stack);
+  return count;
 }
 
 int
@@ -50,30 +244,85 @@ count_number_of_steps(STEP* steps)
   return count;
 }
 
-RECIPE*
-find_by_pid(pid_t pid)
+/**
+ * @brief Modification time of a file, or -1 if it can't be stat'd.
+ */
+static long long
+file_mtime(char* path)
 {
-  RECIPE* rec = main_recipe;
+  struct stat st;
+  if (path == NULL || stat(path, &st) == -1)
+    return -1;
+  return (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
 
-  while (rec != NULL) {
-    if (rec->state != NULL && ((STATE*)rec->state)->worker_pid == pid) {
-      return rec;
+/**
+ * @brief Collects the modification times of the files a recipe produces.
+ * These are the output redirections of its tasks, or the recipe name itself
+ * if none of the tasks redirect their output.
+ *
+ * @param oldest Set to the oldest target, or -1 if any target is missing.
+ * @param newest Set to the newest target, or -1 if any target is missing.
+ */
+static void
+target_mtimes(RECIPE* recipe, long long* oldest, long long* newest)
+{
+  int has_output = 0;
+  *oldest = *newest = -1;
+  for (TASK* task = recipe->tasks; task != NULL; task = task->next) {
+    if (task->output_file == NULL)
+      continue;
+    long long mtime = file_mtime(task->output_file);
+    if (mtime == -1) {
+      *oldest = *newest = -1;
+      return;
     }
-    rec = rec->next;
+    if (!has_output || mtime < *oldest)
+      *oldest = mtime;
+    if (!has_output || mtime > *newest)
+      *newest = mtime;
+    has_output = 1;
   }
-  return NULL;
+  if (!has_output)
+    *oldest = *newest = file_mtime(recipe->name);
+}
+
+int
+is_recipe_up_to_date(int id)
+{
+  RECIPE* recipe = graph.recipes[id];
+  long long oldest, newest;
+  target_mtimes(recipe, &oldest, &newest);
+  if (oldest == -1)
+    return 0;
+
+  for (int j = graph.dependencies_start[id];
+       j < graph.dependencies_start[id + 1];
+       j++) {
+    long long dep_oldest, dep_newest;
+    target_mtimes(graph.recipes[graph.dependencies[j]], &dep_oldest,
+                  &dep_newest);
+    if (dep_newest == -1 || dep_newest > oldest)
+      return 0;
+  }
+  // As with make, a missing input makes the recipe out of date, so that its
+  // steps run and report it.
+  for (TASK* task = recipe->tasks; task != NULL; task = task->next) {
+    long long mtime;
+    if (task->input_file != NULL &&
+        ((mtime = file_mtime(task->input_file)) == -1 || mtime > oldest))
+      return 0;
+  }
+  return 1;
 }
 
 void
-set_main_recipe(char* recipe_name)
+set_main_recipe(COOKBOOK* cbp, char* recipe_name)
 {
-  RECIPE* current_recipe = main_recipe;
-  while (current_recipe != NULL) {
-    if (strcmp(recipe_name, current_recipe->name) == 0) {
-      main_recipe = current_recipe;
-      return;
-    }
-    current_recipe = current_recipe->next;
+  RECIPE* recipe = find_recipe(cbp, recipe_name);
+  if (recipe != NULL) {
+    main_recipe = recipe;
+    return;
   }
   error("Recipe %s not found in the .ckb file!", recipe_name);
   exit(EXIT_FAILURE);
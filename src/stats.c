@@ -0,0 +1,192 @@
+#include "stats.h"
+#include "debug.h"
+#include "hash.h"
+#include "hashtable.h"
+#include "pipeline_utils.h"
+#include "recipe.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATS_SEED 0x73746174ULL
+
+/**
+ * @brief Estimated wall time of a recipe with given tasks, in the index
+ * built by stats_load().
+ *
+ */
+typedef struct
+{
+  uint64_t name_hash;
+  uint64_t task_hash;
+  uint64_t wall_us; // 0 marks an empty slot.
+} ESTIMATE;
+
+static ESTIMATE* estimates;
+static size_t estimate_capacity;
+static STATS_RECORD* recorded;
+static int recorded_count;
+static int recorded_max;
+
+static uint64_t
+name_hash(RECIPE* recipe)
+{
+  HASH_STATE hs;
+  hash_init(&hs, STATS_SEED);
+  hash_string(&hs, recipe->name);
+  return hash_final(&hs);
+}
+
+static int
+holds(const void* slot, const void* key)
+{
+  const ESTIMATE* e = slot;
+  const ESTIMATE* wanted = key;
+  return e->wall_us == 0 || (e->name_hash == wanted->name_hash &&
+                             e->task_hash == wanted->task_hash);
+}
+
+static ESTIMATE*
+find_estimate(uint64_t name, uint64_t tasks)
+{
+  ESTIMATE key = { name, tasks, 0 };
+  return &estimates[hashtable_probe(estimates, sizeof(ESTIMATE),
+                                    estimate_capacity, name ^ tasks, holds,
+                                    &key)];
+}
+
+void
+stats_load()
+{
+  struct stat st;
+  int fd = open(STATS_FILE, O_RDONLY);
+  if (fd == -1)
+    return;
+  if (fstat(fd, &st) == -1 || st.st_size < (off_t)strlen(STATS_MAGIC)) {
+    close(fd);
+    return;
+  }
+  char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return;
+  if (memcmp(data, STATS_MAGIC, strlen(STATS_MAGIC)) != 0) {
+    munmap(data, st.st_size);
+    return;
+  }
+
+  STATS_RECORD* records = (STATS_RECORD*)(data + strlen(STATS_MAGIC));
+  size_t count = (st.st_size - strlen(STATS_MAGIC)) / sizeof(STATS_RECORD);
+  estimate_capacity = hashtable_capacity(count, 64);
+  estimates = calloc(estimate_capacity, sizeof(ESTIMATE));
+  for (size_t i = 0; i < count; i++) {
+    uint64_t wall_us = records[i].wall_us > 0 ? records[i].wall_us : 1;
+    ESTIMATE* e = find_estimate(records[i].name_hash, records[i].task_hash);
+    if (e->wall_us == 0)
+      *e = (ESTIMATE){ records[i].name_hash, records[i].task_hash, wall_us };
+    else
+      e->wall_us = (e->wall_us + wall_us + 1) / 2;
+  }
+  munmap(data, st.st_size);
+  debug("Loaded %zu timings from %s", count, STATS_FILE);
+}
+
+long
+stats_estimate(int id)
+{
+  RECIPE* recipe = graph.recipes[id];
+  if (estimates != NULL) {
+    ESTIMATE* e = find_estimate(name_hash(recipe), graph.states[id].task_hash);
+    if (e->wall_us != 0)
+      return (long)e->wall_us;
+  }
+  long steps = 0;
+  for (TASK* task = recipe->tasks; task != NULL; task = task->next) {
+    for (STEP* step = task->steps; step != NULL; step = step->next)
+      steps++;
+  }
+  return steps * STATS_DEFAULT_STEP_US;
+}
+
+void
+stats_record(int id, uint64_t wall_us, uint64_t cpu_us, uint64_t max_rss_kb)
+{
+  if (recorded_count == recorded_max) {
+    recorded_max = recorded_max ? 2 * recorded_max : 64;
+    recorded = realloc(recorded, recorded_max * sizeof(STATS_RECORD));
+  }
+  recorded[recorded_count++] = (STATS_RECORD){
+    name_hash(graph.recipes[id]), graph.states[id].task_hash, wall_us,
+    cpu_us, max_rss_kb,
+    (uint64_t)time(NULL)
+  };
+}
+
+/**
+ * @brief Replaces the history with its newest STATS_MAX_RECORDS / 2 records
+ * followed by the ones recorded in this run.
+ */
+static void
+compact(int fd, size_t count)
+{
+  char tmp[sizeof(STATS_FILE) + 16];
+  size_t keep = count < STATS_MAX_RECORDS / 2 ? count : STATS_MAX_RECORDS / 2;
+  size_t size = keep * sizeof(STATS_RECORD);
+  off_t from = strlen(STATS_MAGIC) + (count - keep) * sizeof(STATS_RECORD);
+
+  snprintf(tmp, sizeof(tmp), "%s.%d", STATS_FILE, (int)getpid());
+  int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out == -1)
+    return;
+  char* kept = malloc(size);
+  if (pread(fd, kept, size, from) != (ssize_t)size ||
+      write_all(out, STATS_MAGIC, strlen(STATS_MAGIC)) == -1 ||
+      write_all(out, kept, size) == -1 ||
+      write_all(out, recorded, recorded_count * sizeof(STATS_RECORD)) == -1 ||
+      close(out) == -1 || rename(tmp, STATS_FILE) == -1)
+    unlink(tmp);
+  free(kept);
+}
+
+void
+stats_save()
+{
+  struct stat st;
+  if (recorded_count == 0)
+    return;
+  int fd = open(STATS_FILE, O_RDWR | O_CREAT | O_APPEND, 0666);
+  if (fd == -1)
+    return;
+  if (fstat(fd, &st) == 0) {
+    char magic[sizeof(STATS_MAGIC)] = "";
+    size_t count = 0;
+    if (st.st_size >= (off_t)strlen(STATS_MAGIC) &&
+        pread(fd, magic, strlen(STATS_MAGIC), 0) ==
+          (ssize_t)strlen(STATS_MAGIC) &&
+        memcmp(magic, STATS_MAGIC, strlen(STATS_MAGIC)) == 0) {
+      count = (st.st_size - strlen(STATS_MAGIC)) / sizeof(STATS_RECORD);
+      // Drop the tail of a record that was only partly written.
+      if (ftruncate(fd, strlen(STATS_MAGIC) + count * sizeof(STATS_RECORD)) ==
+          -1) {
+        close(fd);
+        return;
+      }
+    } else if (ftruncate(fd, 0) == -1 ||
+             write_all(fd, STATS_MAGIC, strlen(STATS_MAGIC)) == -1) {
+      close(fd);
+      return;
+    }
+
+    if (count + recorded_count > STATS_MAX_RECORDS)
+      compact(fd, count);
+    else
+      write_all(fd, recorded, recorded_count * sizeof(STATS_RECORD));
+  }
+  close(fd);
+}
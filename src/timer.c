@@ -0,0 +1,64 @@
+#include "timer.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+static TIMER_HEAP heap;
+
+void
+timer_add(long long due_us, int id, TIMER_KIND kind)
+{
+  if (heap.count == heap.capacity) {
+    heap.capacity = heap.capacity > 0 ? 2 * heap.capacity : 16;
+    heap.timers = realloc(heap.timers, heap.capacity * sizeof(TIMER));
+  }
+  int i = heap.count++;
+  while (i > 0 && heap.timers[(i - 1) / 2].due_us > due_us) {
+    heap.timers[i] = heap.timers[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap.timers[i] = (TIMER){ due_us, id, kind };
+}
+
+int
+timer_expired(long long now_us, TIMER* timer)
+{
+  if (heap.count == 0 || heap.timers[0].due_us > now_us)
+    return 0;
+  *timer = heap.timers[0];
+  TIMER last = heap.timers[--heap.count];
+
+  int i = 0;
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= heap.count)
+      break;
+    if (child + 1 < heap.count &&
+        heap.timers[child + 1].due_us < heap.timers[child].due_us)
+      child++;
+    if (heap.timers[child].due_us >= last.due_us)
+      break;
+    heap.timers[i] = heap.timers[child];
+    i = child;
+  }
+  heap.timers[i] = last;
+  return 1;
+}
+
+int
+timer_wait_ms(long long now_us)
+{
+  if (heap.count == 0)
+    return -1;
+  long long wait = heap.timers[0].due_us - now_us;
+  if (wait <= 0)
+    return 0;
+  wait = (wait + 999) / 1000;
+  return wait > INT_MAX ? INT_MAX : (int)wait;
+}
+
+int
+timer_is_empty()
+{
+  return heap.count == 0;
+}
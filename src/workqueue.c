@@ -1,54 +1,143 @@
 #include "workqueue.h"
 #include "recipe.h"
+
 #include <string.h>
 
+static QUEUE q;
+static int* held; // Heap of the recipes q_dequeue_if() turned away.
+static int held_count;
+static int* turned_away; // Recipes turned away by one q_dequeue_if().
+
+/**
+ * @brief Returns 1 if recipe a should be cooked before recipe b.
+ */
+static int
+before(int a, int b)
+{
+  long pa = graph.states[a].priority, pb = graph.states[b].priority;
+  return pa > pb || (pa == pb && a < b);
+}
+
 void
-q_enqueue(RECIPE_LINK* recipe)
+q_init(int capacity)
 {
-  STATE* state = malloc(sizeof(STATE));
-  state->status = enqueue;
-  recipe->recipe->state = state;
-
-  QUEUE* cur = q;
-  if (cur == NULL) {
-    cur = malloc(sizeof(QUEUE)); // MAKE SURE TO FREE THIS
-    cur->recipe = recipe;
-    q = cur;
-  } else {
-    QUEUE* node = calloc(1, sizeof(QUEUE));
-    node->recipe = recipe;
-    while (cur != NULL) {
-      if (strcmp(cur->recipe->name, recipe->name) == 0) {
-        free(node);
-        return; // If the recipe exists already, don't add again
-      }
-      if (cur->next == NULL)
-        break;
-      cur = cur->next;
-    }
-    cur->next = node;
+  free(q.recipes);
+  q.recipes = malloc((capacity > 0 ? capacity : 1) * sizeof(int));
+  q.capacity = capacity > 0 ? capacity : 1;
+  q.count = 0;
+  free(q.arrivals);
+  q.arrivals = malloc(q.capacity * sizeof(int));
+  q.arrival_count = 0;
+  free(held);
+  held = malloc(q.capacity * sizeof(int));
+  held_count = 0;
+  free(turned_away);
+  turned_away = malloc(q.capacity * sizeof(int));
+}
+
+static void
+push(int* heap, int* count, int id)
+{
+  int i = (*count)++;
+  while (i > 0 && before(id, heap[(i - 1) / 2])) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = id;
+}
+
+static int
+pop(int* heap, int* count)
+{
+  if (*count == 0)
+    return -1;
+  int id = heap[0];
+  int last = heap[--*count];
+
+  int i = 0;
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= *count)
+      break;
+    if (child + 1 < *count && before(heap[child + 1], heap[child]))
+      child++;
+    if (!before(heap[child], last))
+      break;
+    heap[i] = heap[child];
+    i = child;
   }
+  heap[i] = last;
+  return id;
+}
+
+void
+q_enqueue(int id)
+{
+  STATE* state = &graph.states[id];
+  if (state->queued || q.count + q.arrival_count == q.capacity)
+    return;
+  state->queued = 1;
+  state->status = enqueue;
+  q.arrivals[q.arrival_count++] = id;
+}
+
+int
+q_take_arrivals(int* ids)
+{
+  int count = q.arrival_count;
+  memcpy(ids, q.arrivals, count * sizeof(int));
+  q.arrival_count = 0;
+  return count;
 }
 
 void
+q_insert(int id)
+{
+  push(q.recipes, &q.count, id);
+}
+
+int
 q_dequeue()
 {
-  QUEUE* head = q;
-  STATE* state = head->recipe->recipe->state;
-  state->status = finished;
+  return pop(q.recipes, &q.count);
+}
 
-  // queue_recipes_from_depend_on_this_list(head->recipe);
+int
+q_dequeue_if(int (*admit)(int id), int rescan)
+{
+  int id, admitted, count = 0;
+  // Offer the recipes in priority order, drawing from the ones turned away
+  // before only on a rescan.
+  for (;;) {
+    if (rescan && held_count > 0 &&
+        (q.count == 0 || before(held[0], q.recipes[0])))
+      id = pop(held, &held_count);
+    else
+      id = pop(q.recipes, &q.count);
+    if (id == -1 || (admitted = admit(id)) == 1)
+      break;
+    turned_away[count++] = id;
+    if (admitted == -1) {
+      id = -1;
+      break;
+    }
+  }
+  for (int i = 0; i < count; i++)
+    push(held, &held_count, turned_away[i]);
+  return id;
+}
 
-  q = head->next;
+int
+q_is_empty()
+{
+  return q.count == 0 && q.arrival_count == 0 && held_count == 0;
 }
 
 void
 print_queue()
 {
-  QUEUE* head = q;
-  while (head != NULL) {
-    debug("%s", head->recipe->name);
-    head = head->next;
-  }
+  for (int i = 0; i < q.count; i++)
+    debug("%s (%ld)", graph.recipes[q.recipes[i]]->name,
+          graph.states[q.recipes[i]].priority);
   debug("--");
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <criterion/criterion.h>
 
 #include <string.h>
@@ -36,6 +37,145 @@ Test(basecode_suite, hello_world_test, .timeout=20) {
                  "Program output did not match reference output.");
 }
 
+Test(basecode_suite, up_to_date_recipes_skipped_test, .timeout=20) {
+    // The *_ran.txt files are made by the second task of each recipe, so
+    // they only come back if the recipe is cooked again.
+    char *cmd = "ulimit -t 10; rm -rf tmp/up_to_date && mkdir -p tmp/up_to_date && cd tmp/up_to_date"
+                " && echo stock > src.txt && ../../bin/cook -f ../../tests/rsrc/up_to_date.ckb"
+                " && rm *_ran.txt && ../../bin/cook -f ../../tests/rsrc/up_to_date.ckb"
+                " && test ! -e stock_ran.txt && test ! -e plate_ran.txt"
+                " && touch -d @$(($(date +%s) + 5)) src.txt && ../../bin/cook -f ../../tests/rsrc/up_to_date.ckb"
+                " && test -e stock_ran.txt && test -e plate_ran.txt";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Up to date recipes were cooked, or out of date ones weren't (exit %d)",
+		 return_code);
+}
+
+Test(basecode_suite, keep_going_skips_dependents_test, .timeout=20) {
+    // broth fails (its input is missing): sauce and dinner depend on it,
+    // bread doesn't.
+    char *cmd = "ulimit -t 10; rm -rf tmp/keep_going && mkdir -p tmp/keep_going && cd tmp/keep_going"
+                " && ../../bin/cook -k -c 2 -f ../../tests/rsrc/keep_going.ckb 2> stderr.txt";
+    char *check = "cd tmp/keep_going && test -f bread.txt && test ! -e sauce.txt && test ! -e dinner.txt"
+                  " && grep -qx 'Failed: broth' stderr.txt && grep -qx 'Skipped: sauce dinner' stderr.txt";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_FAILURE,
+                 "Program exited with %d instead of EXIT_FAILURE",
+		 return_code);
+    return_code = WEXITSTATUS(system(check));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Wrong recipes cooked or skipped, or no summary of them.");
+}
+
+Test(basecode_suite, retries_back_off_test, .timeout=20) {
+    // The step fails twice, so it is retried after 0.1s and then 0.2s.
+    char *cmd = "ulimit -t 10; rm -rf tmp/retries && mkdir -p tmp/retries && cd tmp/retries"
+                " && ../../bin/cook -f ../../tests/rsrc/retries.ckb 2> /dev/null";
+    char *check = "test $(wc -l < tmp/retries/attempts.txt) -eq 3";
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int return_code = WEXITSTATUS(system(cmd));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+    return_code = WEXITSTATUS(system(check));
+    cr_assert_eq(return_code, EXIT_SUCCESS, "The step wasn't run three times.");
+    cr_assert(elapsed >= 0.3 && elapsed < 2.0,
+              "Retrying took %.2fs instead of about 0.3s", elapsed);
+}
+
+Test(basecode_suite, timeout_kills_step_group_test, .timeout=20) {
+    // Both steps and the sleep the first one leaves in the background have
+    // to be gone (or at least dead) soon after the 200ms timeout.
+    char *cmd = "ulimit -t 10; rm -rf tmp/timeout && mkdir -p tmp/timeout && cd tmp/timeout"
+                " && ../../bin/cook -f ../../tests/rsrc/timeout.ckb 2> stderr.txt";
+    char *check = "cd tmp/timeout && pid=$(cat sleeper.pid) && for i in $(seq 20); do"
+                  " grep -qs '^State:.*[^Z] (' /proc/$pid/status || exit 0; sleep 0.1; done; exit 1";
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int return_code = WEXITSTATUS(system(cmd));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    cr_assert_eq(return_code, EXIT_FAILURE,
+                 "Program exited with %d instead of EXIT_FAILURE",
+		 return_code);
+    cr_assert(elapsed < 5.0, "Timing out took %.2fs", elapsed);
+    return_code = WEXITSTATUS(system(check));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "A process of the recipe is still running.");
+}
+
+Test(basecode_suite, pipeline_fails_with_any_step_test, .timeout=20) {
+    // Like set -o pipefail: the last step succeeding isn't enough.
+    char *cmd = "ulimit -t 10; rm -rf tmp/pipefail && mkdir -p tmp/pipefail && cd tmp/pipefail"
+                " && ../../bin/cook -f ../../tests/rsrc/pipefail.ckb 2> stderr.txt";
+    char *check = "cd tmp/pipefail && test ! -e plate.txt"
+                  " && grep -qx 'Recipe pipe failed: false exited with status 1' stderr.txt";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_FAILURE,
+                 "Program exited with %d instead of EXIT_FAILURE",
+		 return_code);
+    return_code = WEXITSTATUS(system(check));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "The failed step wasn't reported, or its dependent was cooked.");
+}
+
+Test(basecode_suite, builtins_match_commands_test, .timeout=20) {
+    // rm -f, mkdir -p, touch, cp and echo > file, run by cook itself.
+    char *cmd = "ulimit -t 10; sh tests/rsrc/compare_builtins.sh tests/rsrc/builtins.ckb";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Builtin steps didn't do what the commands they stand for do.");
+}
+
+Test(basecode_suite, builtins_fall_back_test, .timeout=20) {
+    // Other options of the same commands are left to the real programs.
+    char *cmd = "ulimit -t 10; sh tests/rsrc/compare_builtins.sh tests/rsrc/builtin_fallbacks.ckb";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Steps with other options didn't do what the real commands do.");
+}
+
+Test(basecode_suite, cache_hashes_generated_inputs_test, .timeout=20) {
+    // gen.txt is written by a dependency with cp, so the key of "out" can
+    // only be worked out once "gen" has run.
+    char *cmd = "ulimit -t 10; rm -rf tmp/cache_test && mkdir -p tmp/cache_test && cd tmp/cache_test"
+                " && echo v1 > src.txt && ../../bin/cook -C -f ../../tests/rsrc/cache_generated.ckb"
+                " && echo v2 > src.txt && ../../bin/cook -C -f ../../tests/rsrc/cache_generated.ckb"
+                " && echo v4 > src.txt && rm gen.txt out.txt"
+                " && ../../bin/cook -C -f ../../tests/rsrc/cache_generated.ckb";
+    char *cmp = "echo v4 | cmp - tmp/cache_test/out.txt";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+    return_code = WEXITSTATUS(system(cmp));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "out.txt was restored from the cache for an old gen.txt");
+}
+
+Test(basecode_suite, missing_input_out_of_date_test, .timeout=20) {
+    // out.txt exists, but the recipe's input doesn't: it has to run, and fail.
+    char *cmd = "ulimit -t 10; rm -rf tmp/missing_input && mkdir -p tmp/missing_input && cd tmp/missing_input"
+                " && touch out.txt && ../../bin/cook -f ../../tests/rsrc/missing_input.ckb 2> /dev/null";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_FAILURE,
+                 "Program exited with %d instead of EXIT_FAILURE",
+		 return_code);
+}
+
 /* 
 █▀ ▀█▀ █░█ █▀▄ █▀▀ █▄░█ ▀█▀   ▀█▀ █▀▀ █▀ ▀█▀ █▀
 ▄█ ░█░ █▄█ █▄▀ ██▄ █░▀█ ░█░   ░█░ ██▄ ▄█ ░█░ ▄█
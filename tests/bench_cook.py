@@ -0,0 +1,58 @@
+import argparse
+import statistics
+import subprocess
+import sys
+import time
+
+# Times a cook program on a cookbook, optionally against a second build of
+# cook so that two versions of the scheduler can be compared side by side.
+
+def parse_args():
+	parser = argparse.ArgumentParser(description='Benchmark cook on a cookbook',
+		usage='bench_cook.py [-p cook] [-b baseline_cook] -f cookbook [-c max_cooks] [-n runs] [-m main_recipe_name] [-a extra_args]')
+	parser.add_argument('-p', default='bin/cook', help='path of cook program to time (default "bin/cook")')
+	parser.add_argument('-b', help='path of a baseline cook program to compare against')
+	parser.add_argument('-f', required=True, help='path of cookbook to process')
+	parser.add_argument('-c', type=int, default=1, help='number of cooks to use')
+	parser.add_argument('-n', type=int, default=5, help='number of timed runs (default 5)')
+	parser.add_argument('-m', help='main recipe to use')
+	parser.add_argument('-a', default='', help='extra arguments passed to the cook program')
+	return parser.parse_args()
+
+def count_recipes(path):
+	count = 0
+	with open(path) as f:
+		for line in f:
+			if line.strip() and not line[0].isspace() and ':' in line:
+				count += 1
+	return count
+
+def time_cook(program, parsed):
+	argv = [program, '-f', parsed.f, '-c', str(parsed.c)] + parsed.a.split()
+	if parsed.m:
+		argv.append(parsed.m)
+	times = []
+	for _ in range(parsed.n):
+		start = time.perf_counter()
+		result = subprocess.run(argv, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+		elapsed = time.perf_counter() - start
+		if result.returncode != 0:
+			print("ERROR: '" + ' '.join(argv) + "' returned " + str(result.returncode))
+			sys.exit(1)
+		times.append(elapsed)
+	return statistics.median(times)
+
+def report(program, median, recipes):
+	print('{:30s} median {:8.3f}s  {:10.1f} recipes/s'.format(program, median, recipes / median))
+
+if __name__ == '__main__':
+	parsed = parse_args()
+	recipes = count_recipes(parsed.f)
+	print('{:s}: {:d} recipes, {:d} cooks, {:d} runs'.format(parsed.f, recipes, parsed.c, parsed.n))
+
+	median = time_cook(parsed.p, parsed)
+	report(parsed.p, median, recipes)
+	if parsed.b:
+		baseline = time_cook(parsed.b, parsed)
+		report(parsed.b, baseline, recipes)
+		print('speedup: {:.2f}x'.format(baseline / median))
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Usage: compare_builtins.sh cookbook
+#
+# Cooks a cookbook of one-step recipes (plus a main recipe depending on all
+# of them) with cook -k in tmp/builtins/cook, and runs the same steps with
+# the real commands in tmp/builtins/real. Both start from the same files.
+# Fails unless the two directories end up with the same files, contents
+# and modes, and the same recipes fail.
+book=$(realpath "$1")
+cook=$(realpath bin/cook)
+rm -rf tmp/builtins && mkdir -p tmp/builtins/cook tmp/builtins/real || exit 1
+cd tmp/builtins || exit 1
+
+for dir in cook real; do
+  (
+    cd $dir
+    echo victim > victim.txt
+    mkdir adir existing_dir into_dir full_dir
+    touch full_dir/file
+    mkdir tree
+    echo leaf > tree/leaf
+    echo plain > plain.txt
+    echo source > source.txt
+    printf '#!/bin/sh\n' > exec.sh
+    chmod 755 exec.sh
+  )
+done
+
+(cd cook && "$cook" -k -c 1 -f "$book" 2> ../cook_stderr.txt)
+grep '^Failed:' cook_stderr.txt | tr ' ' '\n' | tail -n +2 | sort > cook_failed.txt
+
+# The steps run through env, so that echo isn't the shell's own.
+(
+  cd real
+  name=
+  while IFS= read -r line; do
+    case "$line" in
+      "" | *[!\ \	]*:*) name=${line%%:*} ;;
+      *) eval "env $line" 2> /dev/null || echo "$name" ;;
+    esac
+  done < "$book"
+) | sort > real_failed.txt
+
+for dir in cook real; do
+  (cd $dir && find . ! -name .cook-stats -exec stat -c '%n %a %F %s' {} + | sort) > ${dir}_files.txt
+done
+diff cook_failed.txt real_failed.txt &&
+  diff cook_files.txt real_files.txt &&
+  diff -r -x .cook-stats cook real
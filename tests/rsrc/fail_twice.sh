@@ -0,0 +1,4 @@
+#!/bin/sh
+# Fails the first two times it is run in the current directory.
+echo attempt >> attempts.txt
+[ "$(wc -l < attempts.txt)" -ge 3 ]
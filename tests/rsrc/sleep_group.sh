@@ -0,0 +1,6 @@
+#!/bin/sh
+# Leaves a sleep running in the background, in the same process group, and
+# records its pid so that a test can check it was killed too.
+sleep 30 &
+echo $! > sleeper.pid
+wait
@@ -35,6 +35,7 @@ class Cookbook():
 	def __init__(self):
 		self.recipes = []
 		self.queue = []
+		self.reachable = set()
 
 class Info():
 	def __init__(self, is_start, start_time, pid, delay, words=''):
@@ -196,6 +197,14 @@ def parse_args():
 	parser.add_argument('-x', help='expected output')
 	return parser.parse_args()
 
+# Only the recipes the main recipe depends on (directly or not) get cooked
+def get_reachable(root, reachable):
+	if root in reachable:
+		return
+	reachable.add(root)
+	for cur in root.this_depends_on:
+		get_reachable(cur, reachable)
+
 def get_leaves(root, array):
 	if not root:
 		return
@@ -230,7 +239,7 @@ def remove_recipe(recipe, cookbook, ready_set):
 	for r in recipe.depend_on_this:
 		r.this_depends_on.remove(recipe)
 		#print(r, len(r.this_depends_on), r.tasks[0].steps if len(r.tasks) > 0 else '')
-		if len(r.this_depends_on) == 0 and len(r.tasks) != 0:
+		if len(r.this_depends_on) == 0 and len(r.tasks) != 0 and r in cookbook.reachable:
 			add_to_set.add(r)
 
 	return add_to_set
@@ -314,6 +323,7 @@ def analyze_transcript(cookbook, transcript, main_recipe, max_cooks):
 	root = get_recipe(cookbook, main_recipe)
 	root.done = False
 	ready_set = set()
+	get_reachable(root, cookbook.reachable)
 	get_leaves(root, ready_set)
 	enqueue_steps(ready_set, cookbook)
 